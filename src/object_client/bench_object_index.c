@@ -0,0 +1,75 @@
+/*
+ * Compares the id hash index against the linear scan om_get_object_by_id
+ * used to do, for growing world sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "object_index.h"
+
+#define LOOKUPS 2000000
+
+// keeps the compiler from dropping the lookups
+static volatile long sink;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int scan(const om_object_t *objects, int num_objects, int64_t id)
+{
+    for (int i = 0; i < num_objects; i++)
+        if (objects[i].id == id)
+            return i;
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    srand(42);
+    printf("%8s %14s %14s %14s\n", "objects", "scan ns/op", "index ns/op",
+           "build us");
+
+    for (int n = 4; n <= 32768; n *= 2)
+    {
+        om_object_t *objects = calloc(n, sizeof(om_object_t));
+        for (int i = 0; i < n; i++)
+            objects[i].id = ((int64_t)rand() << 24) ^ rand();
+
+        // ids to look up, in an order unrelated to the list
+        int64_t *ids = malloc(LOOKUPS * sizeof(int64_t));
+        for (int i = 0; i < LOOKUPS; i++)
+            ids[i] = objects[rand() % n].id;
+
+        om_object_index_t *index = om_object_index_new();
+        double t0 = now_sec();
+        om_object_index_build(index, objects, n);
+        double t_build = now_sec() - t0;
+
+        // the scan gets slow fast, so time fewer lookups for large worlds
+        int scan_lookups = n > 1024 ? LOOKUPS / (n / 1024) : LOOKUPS;
+        t0 = now_sec();
+        for (int i = 0; i < scan_lookups; i++)
+            sink += scan(objects, n, ids[i]);
+        double t_scan = now_sec() - t0;
+
+        t0 = now_sec();
+        for (int i = 0; i < LOOKUPS; i++)
+            sink -= om_object_index_lookup(index, ids[i]);
+        double t_index = now_sec() - t0;
+
+        printf("%8d %14.1f %14.1f %14.1f\n", n,
+               1e9 * t_scan / scan_lookups, 1e9 * t_index / LOOKUPS,
+               1e6 * t_build);
+
+        om_object_index_destroy(index);
+        free(ids);
+        free(objects);
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "object_attr_index.h"
+
+/*
+ * Every object has an entry, found by id through a hash table and kept in
+ * two balanced trees (GSequence): one ordered by type, one by label, both
+ * then by id. All objects of a type, or all labels with a prefix, are a
+ * run of neighbours in their tree; a query finds the start of the run in
+ * O(log n) and walks it.
+ *
+ * A sync marks the entry of every object it sees and drops the entries it
+ * did not see, so objects that did not change cost one lookup and compare.
+ */
+
+typedef struct _attr_entry
+{
+    int64_t id;
+    int16_t object_type;
+    char *label;
+    GSequenceIter *by_type;
+    GSequenceIter *by_label;
+    guint mark;             // sync that last saw the object
+} attr_entry_t;
+
+struct _om_attr_index
+{
+    GHashTable *entries;    // id -> attr_entry_t
+    GSequence *by_type;
+    GSequence *by_label;
+    guint mark;
+};
+
+// ids are never this small, so a key with it sorts before every entry of
+// its type or label
+#define KEY_ID G_MININT64
+
+static gint compare_type(gconstpointer a, gconstpointer b, gpointer user)
+{
+    const attr_entry_t *x = (const attr_entry_t*)a;
+    const attr_entry_t *y = (const attr_entry_t*)b;
+    if (x->object_type != y->object_type)
+        return x->object_type < y->object_type ? -1 : 1;
+    if (x->id != y->id)
+        return x->id < y->id ? -1 : 1;
+    return 0;
+}
+
+static gint compare_label(gconstpointer a, gconstpointer b, gpointer user)
+{
+    const attr_entry_t *x = (const attr_entry_t*)a;
+    const attr_entry_t *y = (const attr_entry_t*)b;
+    int c = strcmp(x->label, y->label);
+    if (c)
+        return c;
+    if (x->id != y->id)
+        return x->id < y->id ? -1 : 1;
+    return 0;
+}
+
+static void entry_destroy(gpointer data)
+{
+    attr_entry_t *entry = (attr_entry_t*)data;
+    free(entry->label);
+    free(entry);
+}
+
+om_attr_index_t *om_attr_index_new(void)
+{
+    om_attr_index_t *index = (om_attr_index_t*)calloc(1, sizeof(om_attr_index_t));
+    index->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                           entry_destroy);
+    index->by_type = g_sequence_new(NULL);
+    index->by_label = g_sequence_new(NULL);
+    return index;
+}
+
+void om_attr_index_destroy(om_attr_index_t *index)
+{
+    if (!index) return;
+    g_sequence_free(index->by_type);
+    g_sequence_free(index->by_label);
+    g_hash_table_destroy(index->entries);
+    free(index);
+}
+
+static gboolean drop_unmarked(gpointer key, gpointer value, gpointer user)
+{
+    om_attr_index_t *index = (om_attr_index_t*)user;
+    attr_entry_t *entry = (attr_entry_t*)value;
+    if (entry->mark == index->mark)
+        return FALSE;
+    g_sequence_remove(entry->by_type);
+    g_sequence_remove(entry->by_label);
+    return TRUE;
+}
+
+void om_attr_index_sync(om_attr_index_t *index, const om_object_t *objects,
+                        int num_objects)
+{
+    guint seen = 0;
+    index->mark++;
+    for (int i = 0; i < num_objects; i++)
+    {
+        const om_object_t *obj = &objects[i];
+        const char *label = obj->label ? obj->label : "";
+        attr_entry_t *entry =
+            (attr_entry_t*)g_hash_table_lookup(index->entries, &obj->id);
+        if (!entry)
+        {
+            entry = (attr_entry_t*)calloc(1, sizeof(attr_entry_t));
+            entry->id = obj->id;
+            entry->object_type = obj->object_type;
+            entry->label = strdup(label);
+            g_hash_table_insert(index->entries, &entry->id, entry);
+            entry->by_type = g_sequence_insert_sorted(index->by_type, entry,
+                                                      compare_type, NULL);
+            entry->by_label = g_sequence_insert_sorted(index->by_label, entry,
+                                                       compare_label, NULL);
+        }
+        else if (entry->mark == index->mark)
+            continue;   // repeated id, the first object wins
+        else
+        {
+            if (entry->object_type != obj->object_type)
+            {
+                entry->object_type = obj->object_type;
+                g_sequence_sort_changed(entry->by_type, compare_type, NULL);
+            }
+            if (strcmp(entry->label, label))
+            {
+                free(entry->label);
+                entry->label = strdup(label);
+                g_sequence_sort_changed(entry->by_label, compare_label, NULL);
+            }
+        }
+        entry->mark = index->mark;
+        seen++;
+    }
+
+    if (seen < g_hash_table_size(index->entries))
+        g_hash_table_foreach_remove(index->entries, drop_unmarked, index);
+}
+
+static void append_id(int64_t **ids, int *n, int *capacity, int64_t id)
+{
+    if (*n == *capacity)
+    {
+        *capacity = *capacity ? 2 * *capacity : 16;
+        *ids = (int64_t*)realloc(*ids, *capacity * sizeof(int64_t));
+    }
+    (*ids)[(*n)++] = id;
+}
+
+int om_attr_index_by_type(const om_attr_index_t *index, int16_t object_type,
+                          int64_t **ids)
+{
+    attr_entry_t key = { .id = KEY_ID, .object_type = object_type };
+    int n = 0, capacity = 0;
+    *ids = NULL;
+    for (GSequenceIter *it = g_sequence_search(index->by_type, &key,
+                                               compare_type, NULL);
+         !g_sequence_iter_is_end(it); it = g_sequence_iter_next(it))
+    {
+        attr_entry_t *entry = (attr_entry_t*)g_sequence_get(it);
+        if (entry->object_type != object_type)
+            break;
+        append_id(ids, &n, &capacity, entry->id);
+    }
+    return n;
+}
+
+int64_t om_attr_index_by_label(const om_attr_index_t *index, const char *label)
+{
+    attr_entry_t key = { .id = KEY_ID, .label = (char*)label };
+    GSequenceIter *it = g_sequence_search(index->by_label, &key,
+                                          compare_label, NULL);
+    if (g_sequence_iter_is_end(it))
+        return -1;
+    attr_entry_t *entry = (attr_entry_t*)g_sequence_get(it);
+    return strcmp(entry->label, label) ? -1 : entry->id;
+}
+
+int om_attr_index_by_label_prefix(const om_attr_index_t *index,
+                                  const char *prefix, int64_t **ids)
+{
+    attr_entry_t key = { .id = KEY_ID, .label = (char*)prefix };
+    size_t len = strlen(prefix);
+    int n = 0, capacity = 0;
+    *ids = NULL;
+    for (GSequenceIter *it = g_sequence_search(index->by_label, &key,
+                                               compare_label, NULL);
+         !g_sequence_iter_is_end(it); it = g_sequence_iter_next(it))
+    {
+        attr_entry_t *entry = (attr_entry_t*)g_sequence_get(it);
+        if (strncmp(entry->label, prefix, len))
+            break;
+        append_id(ids, &n, &capacity, entry->id);
+    }
+    return n;
+}
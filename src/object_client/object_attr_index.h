@@ -0,0 +1,63 @@
+#ifndef __OBJECT_ATTR_INDEX_H
+#define __OBJECT_ATTR_INDEX_H
+
+#include <lcmtypes/om_object_t.h>
+
+/*
+ * Indexes of object ids by object_type and by label, for queries like "all
+ * chairs" or "the object labelled dock_3" that would otherwise scan every
+ * object. Unlike the id index and the trees it is not rebuilt for every
+ * list but brought up to date with it, touching only the objects that
+ * came, went or changed type or label.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_attr_index om_attr_index_t;
+
+om_attr_index_t *om_attr_index_new(void);
+
+void om_attr_index_destroy(om_attr_index_t *index);
+
+/**
+ * om_attr_index_sync:
+ * @index The index.
+ * @objects The objects as they are now, which the index does not keep.
+ * @num_objects Number of @objects.
+ *
+ * Updates @index to hold exactly @objects.
+ */
+void om_attr_index_sync(om_attr_index_t *index, const om_object_t *objects,
+                        int num_objects);
+
+/**
+ * om_attr_index_by_type:
+ * @ids (returned) malloc'd ids of the objects of @object_type, ascending;
+ *      free() it.
+ * Returns: The number of @ids.
+ */
+int om_attr_index_by_type(const om_attr_index_t *index, int16_t object_type,
+                          int64_t **ids);
+
+/**
+ * om_attr_index_by_label:
+ * Returns: The lowest id of the objects labelled @label, or -1.
+ */
+int64_t om_attr_index_by_label(const om_attr_index_t *index, const char *label);
+
+/**
+ * om_attr_index_by_label_prefix:
+ * @ids (returned) malloc'd ids of the objects whose label starts with
+ *      @prefix, in label order; free() it.
+ * Returns: The number of @ids.
+ */
+int om_attr_index_by_label_prefix(const om_attr_index_t *index,
+                                  const char *prefix, int64_t **ids);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "object_bvh.h"
+
+/*
+ * Nodes are stored depth first: the left child of an inner node follows
+ * it, the right child is at node->right. Leaves cover a range of boxes,
+ * which are reordered to match. Subtrees are split at the median box
+ * centroid along the longest axis of their centroids.
+ */
+
+#define LEAF_SIZE 4
+
+// half size of the cube used for objects without proper extents
+#define POINT_HALF_SIZE 0.25
+
+typedef struct _bvh_node
+{
+    double min[3];
+    double max[3];
+    int first;      // first box of a leaf
+    int count;      // boxes of a leaf, 0 for inner nodes
+    int right;      // right child of an inner node
+} bvh_node_t;
+
+struct _om_bvh
+{
+    om_bvh_box_t *boxes;
+    int num_boxes;
+    bvh_node_t *nodes;
+    int num_nodes;
+};
+
+// a box while building: its world aligned bounds and centroid
+typedef struct _build_item
+{
+    double min[3];
+    double max[3];
+    double c[3];
+    int box;
+} build_item_t;
+
+om_bvh_t *om_bvh_new(void)
+{
+    return (om_bvh_t*)calloc(1, sizeof(om_bvh_t));
+}
+
+void om_bvh_destroy(om_bvh_t *bvh)
+{
+    if (!bvh) return;
+    free(bvh->boxes);
+    free(bvh->nodes);
+    free(bvh);
+}
+
+void om_bvh_box_set(om_bvh_box_t *box, const double pos[3],
+                    const double orientation[4], const double bbox_min[3],
+                    const double bbox_max[3], int64_t id)
+{
+    memcpy(box->pos, pos, sizeof(box->pos));
+    box->id = id;
+
+    double w = orientation[0], x = orientation[1], y = orientation[2],
+        z = orientation[3];
+    double norm = w*w + x*x + y*y + z*z;
+    if (norm > 0)
+    {
+        double s = 2 / norm;
+        double r[9] = {
+            1 - s*(y*y + z*z), s*(x*y - w*z),     s*(x*z + w*y),
+            s*(x*y + w*z),     1 - s*(x*x + z*z), s*(y*z - w*x),
+            s*(x*z - w*y),     s*(y*z + w*x),     1 - s*(x*x + y*y)
+        };
+        memcpy(box->rot, r, sizeof(box->rot));
+    }
+    else
+    {
+        double r[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+        memcpy(box->rot, r, sizeof(box->rot));
+    }
+
+    // same test as the renderer uses before drawing a bounding box
+    if (bbox_min[0] != bbox_max[0] && bbox_min[1] != bbox_max[1] &&
+        bbox_min[2] != bbox_max[2])
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            box->min[i] = fmin(bbox_min[i], bbox_max[i]);
+            box->max[i] = fmax(bbox_min[i], bbox_max[i]);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            box->min[i] = -POINT_HALF_SIZE;
+            box->max[i] = POINT_HALF_SIZE;
+        }
+    }
+}
+
+static void item_init(build_item_t *item, const om_bvh_box_t *box, int idx)
+{
+    double c[3], h[3];
+    for (int j = 0; j < 3; j++)
+    {
+        c[j] = (box->min[j] + box->max[j]) / 2;
+        h[j] = (box->max[j] - box->min[j]) / 2;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        const double *r = &box->rot[3*i];
+        double center = box->pos[i] + r[0]*c[0] + r[1]*c[1] + r[2]*c[2];
+        double extent = fabs(r[0])*h[0] + fabs(r[1])*h[1] + fabs(r[2])*h[2];
+        item->min[i] = center - extent;
+        item->max[i] = center + extent;
+        item->c[i] = center;
+    }
+    item->box = idx;
+}
+
+static inline void swap_items(build_item_t *a, build_item_t *b)
+{
+    build_item_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// moves the item whose centroid belongs at k (by axis) there, partitioning
+// three ways like the k-d tree does
+static void select_kth(build_item_t *p, int lo, int hi, int k, int axis)
+{
+    while (hi - lo > 1)
+    {
+        double pivot = p[lo + (hi - lo) / 2].c[axis];
+        int lt = lo, i = lo, gt = hi;
+        while (i < gt)
+        {
+            if (p[i].c[axis] < pivot)
+                swap_items(&p[i++], &p[lt++]);
+            else if (p[i].c[axis] > pivot)
+                swap_items(&p[i], &p[--gt]);
+            else
+                i++;
+        }
+        if (k < lt)
+            hi = lt;
+        else if (k >= gt)
+            lo = gt;
+        else
+            return;
+    }
+}
+
+static int build(om_bvh_t *bvh, build_item_t *items, int lo, int hi)
+{
+    int idx = bvh->num_nodes++;
+    bvh_node_t *node = &bvh->nodes[idx];
+
+    double cmin[3], cmax[3];
+    for (int i = 0; i < 3; i++)
+    {
+        node->min[i] = cmin[i] = INFINITY;
+        node->max[i] = cmax[i] = -INFINITY;
+    }
+    for (int k = lo; k < hi; k++)
+        for (int i = 0; i < 3; i++)
+        {
+            node->min[i] = fmin(node->min[i], items[k].min[i]);
+            node->max[i] = fmax(node->max[i], items[k].max[i]);
+            cmin[i] = fmin(cmin[i], items[k].c[i]);
+            cmax[i] = fmax(cmax[i], items[k].c[i]);
+        }
+
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+        if (cmax[i] - cmin[i] > cmax[axis] - cmin[axis])
+            axis = i;
+
+    // boxes sharing one centroid can't be told apart, leave them together
+    if (hi - lo <= LEAF_SIZE || cmax[axis] == cmin[axis])
+    {
+        node->first = lo;
+        node->count = hi - lo;
+        return idx;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    select_kth(items, lo, hi, mid, axis);
+    node->count = 0;
+    build(bvh, items, lo, mid);
+    int right = build(bvh, items, mid, hi);
+    bvh->nodes[idx].right = right;
+    return idx;
+}
+
+void om_bvh_build(om_bvh_t *bvh, om_bvh_box_t *boxes, int num_boxes)
+{
+    free(bvh->boxes);
+    free(bvh->nodes);
+    bvh->num_boxes = num_boxes;
+    bvh->num_nodes = 0;
+    bvh->nodes = (bvh_node_t*)malloc((2 * num_boxes + 1) * sizeof(bvh_node_t));
+
+    build_item_t *items =
+        (build_item_t*)malloc((num_boxes + 1) * sizeof(build_item_t));
+    for (int i = 0; i < num_boxes; i++)
+        item_init(&items[i], &boxes[i], i);
+    if (num_boxes)
+        build(bvh, items, 0, num_boxes);
+
+    // leaves refer to ranges of items, put the boxes in that order
+    bvh->boxes = (om_bvh_box_t*)malloc((num_boxes + 1) * sizeof(om_bvh_box_t));
+    for (int i = 0; i < num_boxes; i++)
+        bvh->boxes[i] = boxes[items[i].box];
+    free(items);
+    free(boxes);
+}
+
+/*
+ * Entry distance of the ray into an axis-aligned box, if it enters it
+ * before limit. Divisions by a zero direction give infinities, and fmin()
+ * and fmax() drop the NaN of a ray running right along a face.
+ */
+static inline int ray_aabb(const double min[3], const double max[3],
+                           const double o[3], const double inv[3],
+                           double limit, double *t)
+{
+    double tmin = 0, tmax = limit;
+    for (int i = 0; i < 3; i++)
+    {
+        double t1 = (min[i] - o[i]) * inv[i];
+        double t2 = (max[i] - o[i]) * inv[i];
+        tmin = fmax(tmin, fmin(t1, t2));
+        tmax = fmin(tmax, fmax(t1, t2));
+    }
+    *t = tmin;
+    return tmin <= tmax;
+}
+
+// distance at which the ray enters the oriented box, or -1
+static double ray_obb(const om_bvh_box_t *box, const double o[3],
+                      const double d[3])
+{
+    double rel[3] = { o[0] - box->pos[0], o[1] - box->pos[1], o[2] - box->pos[2] };
+    double tmin = -INFINITY, tmax = INFINITY;
+    for (int i = 0; i < 3; i++)
+    {
+        // rows of the transposed rotation are its columns
+        double lo = box->rot[i]*rel[0] + box->rot[3+i]*rel[1] + box->rot[6+i]*rel[2];
+        double ld = box->rot[i]*d[0] + box->rot[3+i]*d[1] + box->rot[6+i]*d[2];
+        if (fabs(ld) < 1e-12)
+        {
+            if (lo < box->min[i] || lo > box->max[i])
+                return -1;
+            continue;
+        }
+        double t1 = (box->min[i] - lo) / ld;
+        double t2 = (box->max[i] - lo) / ld;
+        tmin = fmax(tmin, fmin(t1, t2));
+        tmax = fmin(tmax, fmax(t1, t2));
+    }
+    if (tmin > tmax || tmin < 0)
+        return -1;
+    return tmin;
+}
+
+int64_t om_bvh_raycast(const om_bvh_t *bvh, const double origin[3],
+                       const double dir[3], double max_dist, double *dist)
+{
+    double len = sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+    if (!bvh->num_nodes || len == 0)
+        return -1;
+
+    double d[3], inv[3];
+    for (int i = 0; i < 3; i++)
+    {
+        d[i] = dir[i] / len;
+        inv[i] = 1 / d[i];
+    }
+
+    double best = max_dist;
+    int64_t best_id = -1;
+    int stack[128];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp)
+    {
+        const bvh_node_t *node = &bvh->nodes[stack[--sp]];
+        double t;
+        if (!ray_aabb(node->min, node->max, origin, inv, best, &t))
+            continue;
+
+        if (node->count)
+        {
+            for (int k = node->first; k < node->first + node->count; k++)
+            {
+                double hit = ray_obb(&bvh->boxes[k], origin, d);
+                if (hit >= 0 && hit < best)
+                {
+                    best = hit;
+                    best_id = bvh->boxes[k].id;
+                }
+            }
+            continue;
+        }
+
+        // visit the child the ray enters first first
+        int left = node - bvh->nodes + 1, right = node->right;
+        double tl, tr;
+        int hit_l = ray_aabb(bvh->nodes[left].min, bvh->nodes[left].max,
+                             origin, inv, best, &tl);
+        int hit_r = ray_aabb(bvh->nodes[right].min, bvh->nodes[right].max,
+                             origin, inv, best, &tr);
+        if (hit_l && hit_r)
+        {
+            stack[sp++] = tl <= tr ? right : left;
+            stack[sp++] = tl <= tr ? left : right;
+        }
+        else if (hit_l)
+            stack[sp++] = left;
+        else if (hit_r)
+            stack[sp++] = right;
+    }
+
+    if (best_id >= 0 && dist)
+        *dist = best;
+    return best_id;
+}
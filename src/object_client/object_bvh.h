@@ -0,0 +1,67 @@
+#ifndef __OBJECT_BVH_H
+#define __OBJECT_BVH_H
+
+#include <stdint.h>
+
+/*
+ * Bounding volume hierarchy over the oriented bounding boxes of objects,
+ * for ray casts (picking, line of sight). Like the k-d tree it is rebuilt
+ * from scratch for every object list and keeps ids rather than pointers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_bvh_box
+{
+    double  pos[3];     // origin of the box frame in the world
+    double  rot[9];     // box to world rotation, row major
+    double  min[3];     // extents in the box frame
+    double  max[3];
+    int64_t id;
+} om_bvh_box_t;
+
+typedef struct _om_bvh om_bvh_t;
+
+om_bvh_t *om_bvh_new(void);
+
+void om_bvh_destroy(om_bvh_t *bvh);
+
+/**
+ * om_bvh_box_set:
+ * @box The box to fill in.
+ * @pos, @orientation Pose of the object, as in om_object_t.
+ * @bbox_min, @bbox_max Extents of the object in its own frame. Objects
+ *                      without extents along some axis get a small cube
+ *                      around @pos instead.
+ * @id The object id.
+ */
+void om_bvh_box_set(om_bvh_box_t *box, const double pos[3],
+                    const double orientation[4], const double bbox_min[3],
+                    const double bbox_max[3], int64_t id);
+
+/**
+ * om_bvh_build:
+ * @bvh The hierarchy.
+ * @boxes malloc'd boxes; the hierarchy takes them over and reorders them.
+ * @num_boxes Number of @boxes.
+ */
+void om_bvh_build(om_bvh_t *bvh, om_bvh_box_t *boxes, int num_boxes);
+
+/**
+ * om_bvh_raycast:
+ * @origin, @dir The ray; @dir need not be normalized.
+ * @max_dist Ignore hits farther than this along the ray.
+ * @dist (returned) Distance from @origin to the hit, if there is one.
+ * Returns: The id of the first box the ray enters, or -1. Boxes that
+ *          contain @origin are not hit.
+ */
+int64_t om_bvh_raycast(const om_bvh_t *bvh, const double origin[3],
+                       const double dir[3], double max_dist, double *dist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
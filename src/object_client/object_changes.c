@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "object_changes.h"
+
+// what the tracker last reported about an object
+typedef struct _reported
+{
+    int64_t id;
+    double pos[3];
+    double orientation[4];
+    uint32_t seen;          // update in which the object was last listed
+} reported_t;
+
+struct _om_change_tracker
+{
+    double min_translation;
+    double min_rotation;
+
+    GHashTable *reported;   // id -> reported_t
+    uint32_t update;
+
+    GArray *changes;        // om_change_t, reused
+
+    // for the removal sweep
+    const om_object_t *old_objects;
+    const om_object_index_t *old_index;
+};
+
+om_change_tracker_t *om_change_tracker_new(double min_translation,
+                                           double min_rotation)
+{
+    om_change_tracker_t *t =
+        (om_change_tracker_t*)calloc(1, sizeof(om_change_tracker_t));
+    t->min_translation = min_translation;
+    t->min_rotation = min_rotation;
+    t->reported = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free);
+    t->changes = g_array_new(FALSE, FALSE, sizeof(om_change_t));
+    return t;
+}
+
+void om_change_tracker_destroy(om_change_tracker_t *t)
+{
+    if (!t) return;
+    g_hash_table_destroy(t->reported);
+    g_array_free(t->changes, TRUE);
+    free(t);
+}
+
+static void add_change(om_change_tracker_t *t, om_change_type_t type,
+                       int64_t id, const om_object_t *object,
+                       const om_object_t *previous)
+{
+    om_change_t change = {
+        .type = type,
+        .id = id,
+        .object = object,
+        .previous = previous
+    };
+    g_array_append_val(t->changes, change);
+}
+
+static void report_pose(reported_t *r, const om_object_t *obj)
+{
+    memcpy(r->pos, obj->pos, sizeof(r->pos));
+    memcpy(r->orientation, obj->orientation, sizeof(r->orientation));
+}
+
+static gboolean has_moved(const om_change_tracker_t *t, const reported_t *r,
+                          const om_object_t *obj)
+{
+    if (!memcmp(obj->pos, r->pos, sizeof(r->pos)) &&
+        !memcmp(obj->orientation, r->orientation, sizeof(r->orientation)))
+        return FALSE;
+
+    double d_sq = 0;
+    for (int i = 0; i < 3; i++)
+        d_sq += (obj->pos[i] - r->pos[i]) * (obj->pos[i] - r->pos[i]);
+    if (d_sq > t->min_translation * t->min_translation)
+        return TRUE;
+
+    // angle between the two orientations, either sign of the quaternion;
+    // unset (all zero) orientations never count as a turn
+    double dot = 0, norm_a = 0, norm_b = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        dot += obj->orientation[i] * r->orientation[i];
+        norm_a += obj->orientation[i] * obj->orientation[i];
+        norm_b += r->orientation[i] * r->orientation[i];
+    }
+    if (norm_a > 0 && norm_b > 0)
+    {
+        double angle = 2 * acos(fmin(fabs(dot) / sqrt(norm_a * norm_b), 1.0));
+        if (angle > t->min_rotation)
+            return TRUE;
+    }
+
+    // below the thresholds, but a change nonetheless when they are 0
+    return t->min_translation <= 0 && t->min_rotation <= 0;
+}
+
+static gboolean is_modified(const om_object_t *a, const om_object_t *b)
+{
+    return a->object_type != b->object_type ||
+        memcmp(a->bbox_min, b->bbox_min, sizeof(a->bbox_min)) ||
+        memcmp(a->bbox_max, b->bbox_max, sizeof(a->bbox_max)) ||
+        strcmp(a->label ? a->label : "", b->label ? b->label : "");
+}
+
+static gboolean sweep_removed(gpointer key, gpointer value, gpointer user)
+{
+    om_change_tracker_t *t = (om_change_tracker_t*)user;
+    reported_t *r = (reported_t*)value;
+    if (r->seen == t->update)
+        return FALSE;
+
+    int i = t->old_index ? om_object_index_lookup(t->old_index, r->id) : -1;
+    add_change(t, OM_CHANGE_REMOVED, r->id, NULL,
+               i >= 0 ? &t->old_objects[i] : NULL);
+    return TRUE;
+}
+
+int om_change_tracker_update(om_change_tracker_t *t,
+                             const om_object_t *objects, int num_objects,
+                             const om_object_t *old_objects,
+                             const om_object_index_t *old_index,
+                             const om_change_t **changes)
+{
+    g_array_set_size(t->changes, 0);
+    t->update++;
+
+    for (int i = 0; i < num_objects; i++)
+    {
+        const om_object_t *obj = &objects[i];
+        int j = old_index ? om_object_index_lookup(old_index, obj->id) : -1;
+        const om_object_t *previous = j >= 0 ? &old_objects[j] : NULL;
+
+        reported_t *r = (reported_t*)g_hash_table_lookup(t->reported, &obj->id);
+        if (!r)
+        {
+            r = (reported_t*)malloc(sizeof(reported_t));
+            r->id = obj->id;
+            report_pose(r, obj);
+            g_hash_table_insert(t->reported, &r->id, r);
+            add_change(t, OM_CHANGE_ADDED, obj->id, obj, previous);
+        }
+        else if (r->seen == t->update)
+            continue;   // id listed twice, the first one counts
+        else
+        {
+            if (has_moved(t, r, obj))
+            {
+                report_pose(r, obj);
+                add_change(t, OM_CHANGE_MOVED, obj->id, obj, previous);
+            }
+            if (previous && is_modified(obj, previous))
+                add_change(t, OM_CHANGE_MODIFIED, obj->id, obj, previous);
+        }
+        r->seen = t->update;
+    }
+
+    t->old_objects = old_objects;
+    t->old_index = old_index;
+    g_hash_table_foreach_remove(t->reported, sweep_removed, t);
+
+    *changes = (const om_change_t*)t->changes->data;
+    return t->changes->len;
+}
@@ -0,0 +1,70 @@
+#ifndef __OBJECT_CHANGES_H
+#define __OBJECT_CHANGES_H
+
+#include <lcmtypes/om_object_t.h>
+
+#include "object_index.h"
+
+/*
+ * Works out which objects were added, moved, otherwise modified or removed
+ * from one object list to the next, for om_subscribe_changes().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    OM_CHANGE_ADDED,
+    OM_CHANGE_MOVED,        // position or orientation changed beyond the thresholds
+    OM_CHANGE_MODIFIED,     // bounding box, type or label changed
+    OM_CHANGE_REMOVED
+} om_change_type_t;
+
+typedef struct _om_change
+{
+    om_change_type_t type;
+    int64_t id;
+    const om_object_t *object;      // current state, NULL if removed
+    const om_object_t *previous;    // state in the previous list, or NULL
+} om_change_t;
+
+typedef struct _om_change_tracker om_change_tracker_t;
+
+/**
+ * om_change_tracker_new:
+ * @min_translation Report a move once an object moved this far [m] ...
+ * @min_rotation ... or turned by this angle [rad] since it was last
+ *               reported; 0 reports every change.
+ */
+om_change_tracker_t *om_change_tracker_new(double min_translation,
+                                           double min_rotation);
+
+void om_change_tracker_destroy(om_change_tracker_t *tracker);
+
+/**
+ * om_change_tracker_update:
+ * @tracker The tracker.
+ * @objects The new object list.
+ * @num_objects Number of @objects.
+ * @old_objects The previous object list, used for om_change_t.previous.
+ * @old_index Index of @old_objects.
+ * @changes (returned) The changes, owned by @tracker and valid until the
+ *          next update. They point into @objects and @old_objects.
+ * Returns: The number of changes.
+ *
+ * Runs in time linear in the number of objects: every object is looked up
+ * by id in hashes rather than compared against a sorted list.
+ */
+int om_change_tracker_update(om_change_tracker_t *tracker,
+                             const om_object_t *objects, int num_objects,
+                             const om_object_t *old_objects,
+                             const om_object_index_t *old_index,
+                             const om_change_t **changes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,4 +1,10 @@
-q#include "object_client.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "object_client.h"
 
 #define ERR(fmt, ...) \
 do { \
@@ -45,244 +51,2454 @@ do { \
 #define dbg_m4v3v3(m,u,v)
 #endif
 
-uint64_t get_unique_id() 
+// objects farther away are never returned by om_get_object_id_by_pos
+#define OM_NEAREST_MAX_DIST 20.0
+
+// our own updates are shown at most this long without the server echoing them
+#define OM_OVERLAY_TIMEOUT_USEC 1000000
+
+// how long the LCM thread of om_new_threaded() blocks before checking for exit
+#define OM_LCM_THREAD_POLL_MS 100
+
+// how often a shared memory reader checks whether the server replaced the segment
+#define OM_SHM_RECHECK_USEC 1000000
+
+// how long to wait for the server to answer an id block request before asking again
+#define OM_ID_BLOCK_RETRY_USEC 1000000
+
+// the nearby candidates reach this much [m] past the nearby radius, so the
+// robot can move that far before the world has to be scanned again
+#define OM_NEARBY_SLACK 1.0
+
+// parts of objects closer to a camera than this [m] are not projected
+#define OM_VIEW_NEAR_PLANE 0.05
+
+// weight of the newest message in the receive rate averages
+#define OM_STATS_RATE_ALPHA 0.1
+
+/*
+ * Snapshots, see object_snapshot.h. om->snapshots.current is the current
+ * world, and om->ol points into it. Taking in a list normally allocates
+ * nothing, as the snapshots of old lists are reused.
+ */
+
+static void _om_lazy_decode(ObjectWorldModel *om);
+static void _om_nearby_collect(ObjectWorldModel *om);
+
+/*
+ * Stats, see om_get_stats(). Everything is updated with the mutex held.
+ */
+static void _om_stats_sample(om_stats_ring_t *ring, int64_t usec)
 {
-    return (0xefffffffffffffff&(bot_timestamp_now()<<8)) + 256*rand()/RAND_MAX;
+    ring->samples[ring->next] = (int32_t)MIN(usec, G_MAXINT32);
+    ring->next = (ring->next + 1) % OM_STATS_SAMPLES;
+    if (ring->count < OM_STATS_SAMPLES)
+        ring->count++;
 }
 
-int om_add_object(ObjectWorldModel *om, om_object_t *obj)
+static int _om_stats_compare(const void *a, const void *b)
 {
-    // set the object id if not set by the calling process
-    // (object ids required to be > 1 (or is it 0?))
-    if (obj->id <= 0)
-        obj->id = get_unique_id();
+    int32_t va = *(const int32_t*)a, vb = *(const int32_t*)b;
+    return (va > vb) - (va < vb);
+}
 
-    om_object_list_t list =
-    {
-        .utime = obj->utime,
-        .num_objects = 1,
-        .objects = obj
-    };
-    return om_object_list_t_publish(om->lcm, OBJECT_ADD_CHANNEL, &list);
+/**
+ * Puts the given percentiles (0..1) of the samples in ring into values.
+ */
+static void _om_stats_percentiles(const om_stats_ring_t *ring, int n,
+                                  const double *p, int32_t *values)
+{
+    int32_t sorted[OM_STATS_SAMPLES];
+    memcpy(sorted, ring->samples, ring->count * sizeof(int32_t));
+    qsort(sorted, ring->count, sizeof(int32_t), _om_stats_compare);
+    for (int i = 0; i < n; i++)
+        values[i] = ring->count ? sorted[(int)(p[i] * (ring->count - 1))] : 0;
 }
-void om_update_object(ObjectWorldModel *om, om_object_t *obj)
+
+/**
+ * Accounts for a message of size bytes carrying (part of) an object list.
+ */
+static void _om_stats_received(ObjectWorldModel *om, int size)
 {
-    om_object_list_t list =
+    int64_t now = bot_timestamp_now();
+    if (om->stats_last_receive)
     {
-      .utime = bot_timestamp_now(),
-      .num_objects = 1,
-      .objects = obj
-    };
-    om_object_list_t_publish(om->lcm, OBJECT_UPDATE_CHANNEL, &list);
+        double interval = now - om->stats_last_receive;
+        double a = om->stats_messages_received > 1 ? OM_STATS_RATE_ALPHA : 1;
+        om->stats_interval_avg += a * (interval - om->stats_interval_avg);
+        om->stats_bytes_avg += a * (size - om->stats_bytes_avg);
+    }
+    om->stats_last_receive = now;
+    om->stats_messages_received++;
+    om->stats_bytes_received += size;
 }
 
+/**
+ * Locks the mutex for a query, keeping track of how long that took when
+ * it could not be had right away.
+ */
+static void _om_lock_query(ObjectWorldModel *om)
+{
+    if (g_static_rec_mutex_trylock(&om->mutex))
+        return;
+    int64_t start = bot_timestamp_now();
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_stats_sample(&om->stats_lock_wait, bot_timestamp_now() - start);
+    om->stats_lock_waits++;
+}
 
-void om_update_object_pos(ObjectWorldModel *om, om_object_t *obj,
-        double x, double y, double z)
+/*
+ * Ids made up by this process, see object_ids.h. The prefix is picked on
+ * first use and again in a forked child, which would otherwise go on with
+ * the parent's ids. The counter running past OM_ID_COUNTER_BITS moves on
+ * to the next prefix.
+ */
+static volatile int64_t _om_id_prefix = -1;
+static volatile int64_t _om_id_counter;
+
+static int64_t _om_id_random_prefix(void)
 {
-    obj->pos[0] = x;
-    obj->pos[1] = y;
-    obj->pos[2] = z;
-    
-    om_object_list_t list =
+    // g_random_int() alone would repeat in every child forked from one state
+    guint32 r = g_random_int() ^ ((guint32)getpid() * 2654435761u) ^
+        (guint32)bot_timestamp_now();
+    return r & (((int64_t)1 << OM_ID_PREFIX_BITS) - 1);
+}
+
+static void _om_id_after_fork(void)
+{
+    _om_id_prefix = _om_id_random_prefix();
+    _om_id_counter = 0;
+}
+
+/**
+ * Reserves n ids of this process with a single atomic add, taking no lock.
+ * Returns the counter of the first one, for _om_local_id().
+ */
+static int64_t _om_local_ids_reserve(int n, int64_t *prefix)
+{
+    *prefix = _om_id_prefix;
+    if (G_UNLIKELY(*prefix < 0))
     {
-      .utime = bot_timestamp_now(),
-      .num_objects = 1,
-      .objects = obj
-    };
-    om_object_list_t_publish(om->lcm, OBJECT_UPDATE_CHANNEL, &list);
+        if (__sync_bool_compare_and_swap(&_om_id_prefix, -1,
+                                         _om_id_random_prefix()))
+            pthread_atfork(NULL, NULL, _om_id_after_fork);
+        *prefix = _om_id_prefix;
+    }
+    return __sync_fetch_and_add(&_om_id_counter, n);
 }
 
-void om_update_object_pos_by_id(ObjectWorldModel *om, int64_t id,
-        double x, double y, double z)
+static inline int64_t _om_local_id(int64_t prefix, int64_t count)
 {
-    om_object_t *obj = om_get_object_by_id(om, id);
-    om_update_object_pos(om, obj, x, y, z);
-    om_object_t_destroy(obj);
+    int64_t p = (prefix + (count >> OM_ID_COUNTER_BITS)) &
+        (((int64_t)1 << OM_ID_PREFIX_BITS) - 1);
+    return OM_ID_LOCAL_BIT | (p << OM_ID_COUNTER_BITS) |
+        (count & (((int64_t)1 << OM_ID_COUNTER_BITS) - 1));
 }
 
-void om_move_object_by_by_id(ObjectWorldModel *om, int64_t id,
-        double dx, double dy, double dz)
+uint64_t get_unique_id() 
 {
-    om_object_t *obj = om_get_object_by_id(om, id);
-    om_update_object_pos(om, obj,
-            obj->pos[0] + dx,
-            obj->pos[1] + dy,
-            obj->pos[2] + dz);
-    om_object_t_destroy(obj);
+    int64_t prefix;
+    int64_t count = _om_local_ids_reserve(1, &prefix);
+    return _om_local_id(prefix, count);
 }
 
-// XXX Get a guarantee that it's sorted and use binary search?
-om_object_t *om_get_object_by_id(ObjectWorldModel *om, int64_t id)
+/**
+ * Asks the server for another id block if the ones we have run low and
+ * no request is under way. The mutex must be held.
+ */
+static void _om_request_id_block(ObjectWorldModel *om)
 {
-    g_static_rec_mutex_lock(&om->mutex);
-    if (NULL != om->ol)
+    int64_t now = bot_timestamp_now();
+    if (om->id_block_size <= 0 || om->id_spare_next < om->id_spare_end ||
+        om->id_end - om->id_next >= om->id_block_size / 2 ||
+        (om->id_block_request_id &&
+         now - om->id_block_request_utime < OM_ID_BLOCK_RETRY_USEC))
+        return;
+
+    om_id_block_request_t req =
+    {
+        .utime = now,
+        .request_id = ((int64_t)g_random_int() << 31) ^ g_random_int(),
+        .count = om->id_block_size
+    };
+    om->id_block_request_id = req.request_id;
+    om->id_block_request_utime = now;
+    om_id_block_request_t_publish(om->lcm, OM_ID_BLOCK_REQUEST_CHANNEL, &req);
+}
+
+/**
+ * Gives the objects without id (<= 0) fresh ones, from the server's
+ * blocks as long as they last. Without blocks this takes no lock.
+ */
+static void _om_assign_ids(ObjectWorldModel *om, om_object_t *objects, int n)
+{
+    int i = 0, missing = 0;
+    for (int j = 0; j < n; j++)
+        if (objects[j].id <= 0)
+            missing++;
+    if (!missing)
+        return;
+
+    if (g_atomic_int_get(&om->id_block_size) > 0)
     {
-        for (int i = 0; i < om->ol->num_objects; i++)
+        g_static_rec_mutex_lock(&om->mutex);
+        for (; i < n; i++)
         {
-            om_object_t *obj = &om->ol->objects[i];
-            if (obj->id == id)
+            if (objects[i].id > 0)
+                continue;
+            if (om->id_next == om->id_end && om->id_spare_next < om->id_spare_end)
             {
-                om_object_t *rtn = (obj ? om_object_t_copy(obj) : NULL);
-                g_static_rec_mutex_unlock(&om->mutex);
-                return rtn;
+                om->id_next = om->id_spare_next;
+                om->id_end = om->id_spare_end;
+                om->id_spare_next = om->id_spare_end = 0;
             }
+            if (om->id_next == om->id_end)
+                break;
+            objects[i].id = om->id_next++;
         }
+        _om_request_id_block(om);
+        g_static_rec_mutex_unlock(&om->mutex);
     }
-    g_static_rec_mutex_unlock(&om->mutex);
-    //ERR("No object with ID %"PRId64" exists!\n", id);
 
-    return NULL;
+    // the rest are made up locally, one atomic add for all of them
+    int local = 0;
+    for (int j = i; j < n; j++)
+        if (objects[j].id <= 0)
+            local++;
+    if (local)
+    {
+        int64_t prefix;
+        int64_t count = _om_local_ids_reserve(local, &prefix);
+        for (; i < n; i++)
+            if (objects[i].id <= 0)
+                objects[i].id = _om_local_id(prefix, count++);
+    }
 }
 
+/**
+ * Handles the server's answer to an id block request.
+ */
+static void _om_on_id_block(const lcm_recv_buf_t *rbuf, const char *channel,
+                            const om_id_block_t *msg, void *user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    if (msg->request_id == om->id_block_request_id)
+    {
+        om->id_block_request_id = 0;
+        if (msg->count <= 0)
+            ERR("The server has no ids left to hand out\n");
+        else if (om->id_next == om->id_end)
+        {
+            om->id_next = msg->first_id;
+            om->id_end = msg->first_id + msg->count;
+        }
+        else
+        {
+            om->id_spare_next = msg->first_id;
+            om->id_spare_end = msg->first_id + msg->count;
+        }
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+}
 
-int64_t om_get_object_id_by_pos(ObjectWorldModel *om, double x, double y,
-                                double z, double *dist)
+void om_set_id_block_size(ObjectWorldModel *om, int block_size)
 {
     g_static_rec_mutex_lock(&om->mutex);
+    g_atomic_int_set(&om->id_block_size, MIN(block_size, OM_ID_BLOCK_MAX));
+    _om_request_id_block(om);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
 
-    if (NULL != om->ol) 
+/*
+ * Async publishing, see om_set_async_publish(). Callers only copy their
+ * update into the queue; the publisher thread drains it, keeps the latest
+ * update of every object and publishes those as one list.
+ *
+ * Callers push without the mutex, so that one blocked on a full queue does
+ * not stall everyone else. They count themselves in publish_pushers while
+ * they do, and the queue is only destroyed once none are left.
+ */
+typedef struct _om_queued_update
+{
+    om_object_t obj;
+    int seq;        // order it was drained in
+} om_queued_update_t;
+
+static int _om_queued_update_compare(const void *a, const void *b)
+{
+    const om_queued_update_t *x = (const om_queued_update_t*)a;
+    const om_queued_update_t *y = (const om_queued_update_t*)b;
+    if (x->obj.id != y->obj.id)
+        return x->obj.id < y->obj.id ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+static gpointer _om_publish_thread(gpointer user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    om_publish_queue_t *queue = om->publish_queue;
+    GArray *queued = g_array_new(FALSE, FALSE, sizeof(om_queued_update_t));
+    GArray *objects = g_array_new(FALSE, FALSE, sizeof(om_object_t));
+
+    for (;;)
     {
-        double min_dist = 20.0; // no point in considering objects farther than 10m
-        int64_t closest_id = -1;
+        om_publish_queue_wait(queue);
+        // whatever was queued before we were told to quit still goes out
+        int quit = g_atomic_int_get(&om->publish_thread_quit);
 
-        for (int i = 0; i < om->ol->num_objects; i++) 
+        om_queued_update_t update;
+        while (om_publish_queue_pop(queue, &update.obj))
+        {
+            update.seq = queued->len;
+            g_array_append_val(queued, update);
+        }
+        if (!queued->len)
         {
-            om_object_t *obj = &om->ol->objects[i];
-            double dist = sqrt (bot_sq(obj->pos[0]-x) + bot_sq(obj->pos[1]-y) 
-                                + bot_sq(obj->pos[2]-z));
+            if (quit)
+                break;
+            continue;
+        }
 
-            if (dist < min_dist) {
-                min_dist = dist;
-                closest_id = obj->id;
-            }
+        qsort(queued->data, queued->len, sizeof(om_queued_update_t),
+              _om_queued_update_compare);
+        for (int i = 0; i < queued->len; i++)
+        {
+            om_queued_update_t *u = &g_array_index(queued, om_queued_update_t, i);
+            if (i + 1 < queued->len &&
+                g_array_index(queued, om_queued_update_t, i + 1).obj.id == u->obj.id)
+                free(u->obj.label);     // a later update replaces it
+            else
+                g_array_append_val(objects, u->obj);
         }
 
-        *dist = min_dist;
-        g_static_rec_mutex_unlock(&om->mutex);
-        return closest_id;
+        om_object_list_t list =
+        {
+            .utime = bot_timestamp_now(),
+            .num_objects = objects->len,
+            .objects = (om_object_t*)objects->data
+        };
+        om_object_list_t_publish(om->lcm, OBJECT_UPDATE_CHANNEL, &list);
+
+        for (int i = 0; i < objects->len; i++)
+            free(g_array_index(objects, om_object_t, i).label);
+        g_array_set_size(objects, 0);
+        g_array_set_size(queued, 0);
+        if (quit)
+            break;
     }
-    else
-    {
-        *dist = DBL_MAX;
-        g_static_rec_mutex_unlock(&om->mutex);
-        return -1;
-    }   
+
+    g_array_free(queued, TRUE);
+    g_array_free(objects, TRUE);
+    return NULL;
 }
 
 /**
- * Handles the LCM message that publishes all known objects.
+ * Stops the publisher thread after it published what is queued. The mutex
+ * must be held.
  */
-void _om_on_object_list(const lcm_recv_buf_t *rbuf, const char *channel,
-                        const om_object_list_t *msg, void *user)
+static void _om_stop_async_publish(ObjectWorldModel *om)
 {
-    //fprintf(stderr,"Received\n");
-    ObjectWorldModel *om = (ObjectWorldModel*)user;
-    g_static_rec_mutex_lock(&om->mutex);
-    if (om->ol) om_object_list_t_destroy(om->ol);
-    om->ol = om_object_list_t_copy(msg);
-    g_static_rec_mutex_unlock(&om->mutex);
+    om_publish_queue_t *queue = om->publish_queue;
+    if (!queue)
+        return;
+    // no new pushers; the ones still pushing may wait for the thread to
+    // make room, so it keeps running until they are done
+    om->publish_queue = NULL;
+    while (g_atomic_int_get(&om->publish_pushers))
+        g_thread_yield();
+
+    g_atomic_int_set(&om->publish_thread_quit, 1);
+    om_publish_queue_wake(queue);
+    g_thread_join(om->publish_thread);
+    om->publish_thread = NULL;
+
+    om->publish_dropped += om_publish_queue_get_dropped(queue);
+    om_publish_queue_destroy(queue);
 }
 
 /**
- * Handles the LCM message that publishes the position of the forklift.
+ * Returns the queue for async publishing, or NULL if it is off. The caller
+ * may push to it after releasing the mutex, and must call
+ * _om_publish_queue_leave() when done. The mutex must be held.
  */
-void _om_on_pose(const lcm_recv_buf_t *rbuf, const char *channel,
-                 const bot_core_pose_t *msg, void *user)
+static om_publish_queue_t *_om_publish_queue_enter(ObjectWorldModel *om)
 {
-    ObjectWorldModel *om = (ObjectWorldModel*)user;
-    g_static_rec_mutex_lock(&om->mutex);
-    if (om->pose) bot_core_pose_t_destroy(om->pose);
-    om->pose = bot_core_pose_t_copy(msg);
-    g_static_rec_mutex_unlock(&om->mutex);
+    if (om->publish_queue)
+        g_atomic_int_inc(&om->publish_pushers);
+    return om->publish_queue;
 }
 
+static void _om_publish_queue_leave(ObjectWorldModel *om)
+{
+    g_atomic_int_add(&om->publish_pushers, -1);
+}
 
+void om_set_async_publish(ObjectWorldModel *om, int capacity,
+                          om_queue_policy_t policy)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_stop_async_publish(om);
+    if (capacity > 0)
+    {
+        GError *err = NULL;
+        om->publish_queue = om_publish_queue_new(capacity, policy);
+        om->publish_thread_quit = 0;
+        om->publish_thread = g_thread_create(_om_publish_thread, om, TRUE, &err);
+        if (!om->publish_thread)
+        {
+            ERR("Could not start the publisher thread: %s\n",
+                err ? err->message : "");
+            om_publish_queue_destroy(om->publish_queue);
+            om->publish_queue = NULL;
+        }
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+}
 
-ObjectWorldModel *om_new()
+/**
+ * Publishes objects on channel as one list.
+ */
+static int _om_publish_objects(ObjectWorldModel *om, const char *channel,
+                               om_object_t *objects, int num_objects,
+                               int64_t list_utime)
 {
-    ObjectWorldModel *om = (ObjectWorldModel*)calloc(1, sizeof(ObjectWorldModel));
+    om_object_list_t list =
+    {
+        .utime = list_utime,
+        .num_objects = num_objects,
+        .objects = objects
+    };
+    return om_object_list_t_publish(om->lcm, channel, &list);
+}
 
-    if (!(om->lcm = bot_lcm_get_global(NULL))){
-        //add lcm to mainloop 
-        free(om);
+/*
+ * Flushing a batch: _om_batch_take() moves the batch out of om with the
+ * mutex held, _om_batch_send() publishes or queues it after the mutex was
+ * released, so a push into a full queue does not stall everyone else.
+ * Batches are sent in the order they were taken, or an older update of
+ * an object could overtake a newer one.
+ */
+typedef struct _om_batch_out
+{
+    GArray *objects;            // om_object_t, labels owned; NULL if empty
+    om_publish_queue_t *queue;  // entered, if async publishing is on
+    guint ticket;               // place in the order of batches taken
+} om_batch_out_t;
 
-        ERR("Could not get LCM!\n");
-        return NULL;
+/**
+ * Moves everything in the open batch to out, after what is already there.
+ * The mutex must be held.
+ */
+static void _om_batch_take(ObjectWorldModel *om, om_batch_out_t *out)
+{
+    if (om->batch_timer)
+    {
+        g_source_remove(om->batch_timer);
+        om->batch_timer = 0;
     }
-    bot_glib_mainloop_attach_lcm (om->lcm);
+    om->batch_deadline = 0;
+    if (!om->batch->len)
+        return;
 
-    // Set up param
-    if (!(om->param = bot_param_new_from_server(om->lcm, 1)))
+    if (!out->objects)
     {
-        free(om);
-
-        ERR("Could not get BotConf!\n");
-        return NULL;
+        out->objects = om->batch;
+        om->batch = g_array_new(FALSE, FALSE, sizeof(om_object_t));
+        out->queue = _om_publish_queue_enter(om);
+        out->ticket = om->batch_taken++;
     }
-
-    // Create a hash table for me to quickly receive BotCamTrans objects.
-    /*if (!(om->hash = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                           free, (GDestroyNotify)bot_camtrans_destroy)))
+    else
     {
-        om_destroy(om);
-        ERR("Could not make hash table!\n");
-        return NULL;
-        }*/
-    
-    /*char **cam_names = arconf_get_all_camera_names(om->config);
-    for (int i = 0; cam_names && cam_names[i]; i++)
+        g_array_append_vals(out->objects, om->batch->data, om->batch->len);
+        g_array_set_size(om->batch, 0);
+    }
+    g_hash_table_remove_all(om->batch_ids);
+}
+
+/**
+ * Publishes the objects taken out as one list, or queues them in async
+ * mode, and frees them. The mutex must not be held.
+ */
+static int _om_batch_send(ObjectWorldModel *om, om_batch_out_t *out)
+{
+    if (!out->objects)
+        return 0;
+
+    g_mutex_lock(om->batch_send_mutex);
+    while (om->batch_sent != out->ticket)
+        g_cond_wait(om->batch_send_cond, om->batch_send_mutex);
+    g_mutex_unlock(om->batch_send_mutex);
+
+    GArray *objects = out->objects;
+    int rc = 0;
+    if (out->queue)
     {
-        BotCamTrans *camtrans = arconf_get_new_camtrans(om->config, cam_names[i]);
-        if (camtrans)
-            g_hash_table_insert(om->hash, g_strdup(cam_names[i]), camtrans);
-        else
-            ERR("Could not get BotCamTrans for %s.\n", cam_names[i]);
+        for (int i = 0; i < objects->len; i++)
+            om_publish_queue_push(out->queue, &g_array_index(objects, om_object_t, i));
+        _om_publish_queue_leave(om);
     }
-    if (cam_names) bot_conf_str_array_free(cam_names);
+    else
+        rc = _om_publish_objects(om, OBJECT_UPDATE_CHANNEL,
+                                 (om_object_t*)objects->data, objects->len,
+                                 bot_timestamp_now());
 
-    if (!g_hash_table_size(om->hash))
-    ERR("No valid camera parameter sets found in config system\n");*/
+    g_mutex_lock(om->batch_send_mutex);
+    om->batch_sent++;
+    g_cond_broadcast(om->batch_send_cond);
+    g_mutex_unlock(om->batch_send_mutex);
 
-    // Blocking to resolve concurrent modifications.
-    g_static_rec_mutex_init(&om->mutex);
+    for (int i = 0; i < objects->len; i++)
+        free(g_array_index(objects, om_object_t, i).label);
+    g_array_free(objects, TRUE);
+    out->objects = NULL;
+    return rc;
+}
 
-    om->ol_sub = om_object_list_t_subscribe(om->lcm,
-              OM_OL_CHANNEL, &_om_on_object_list, om);
-    
-    om->pose_sub = bot_core_pose_t_subscribe(om->lcm,
-               OM_POS_CHANNEL, &_om_on_pose, om);
-    
-    if (!om->ol_sub || !om->pose_sub)
+static gboolean _om_batch_timeout(gpointer user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    om_batch_out_t out = { 0 };
+    g_static_rec_mutex_lock(&om->mutex);
+    om->batch_timer = 0;  // we return FALSE, glib drops the source itself
+    _om_batch_take(om, &out);
+    g_static_rec_mutex_unlock(&om->mutex);
+    _om_batch_send(om, &out);
+    return FALSE;
+}
+
+/**
+ * Adds a copy of obj to the open batch, replacing an earlier update of the
+ * same object. A full batch is taken out to out, for the caller to send
+ * with _om_batch_send() once it released the mutex. The mutex must be
+ * held.
+ */
+static void _om_batch_add(ObjectWorldModel *om, const om_object_t *obj,
+                          om_batch_out_t *out)
+{
+    om_object_t *dst;
+    gpointer pos;
+    if (g_hash_table_lookup_extended(om->batch_ids, &obj->id, NULL, &pos))
     {
-        om_destroy(om);
-        ERR("Could not get subscribe to LCM messages!\n");
-        return NULL;
+        dst = &g_array_index(om->batch, om_object_t, GPOINTER_TO_INT(pos));
+        free(dst->label);
     }
+    else
+    {
+        int64_t *key = (int64_t*)malloc(sizeof(int64_t));
+        *key = obj->id;
+        g_hash_table_insert(om->batch_ids, key, GINT_TO_POINTER(om->batch->len));
+        g_array_set_size(om->batch, om->batch->len + 1);
+        dst = &g_array_index(om->batch, om_object_t, om->batch->len - 1);
+    }
+    memcpy(dst, obj, sizeof(om_object_t));
+    dst->label = strdup(obj->label ? obj->label : "");
 
-    // Add some default (empty) lists to prevent future segfaults.
-    om->ol = calloc(1, sizeof(om_object_list_t));
+    if (om->batch_max_objects > 0 && om->batch->len >= om->batch_max_objects)
+        _om_batch_take(om, out);
+    else if (om->batch_max_delay_ms > 0 && !om->batch_deadline)
+    {
+        om->batch_deadline = bot_timestamp_now() +
+            (int64_t)om->batch_max_delay_ms * 1000;
+        // the LCM thread of threaded objects flushes, others need the main loop
+        if (!om->lcm_thread)
+            om->batch_timer = g_timeout_add(om->batch_max_delay_ms,
+                                            _om_batch_timeout, om);
+    }
+}
 
-    return om;
+/*
+ * Overlay: our own updates the server has not echoed yet, see
+ * om_set_overlay(). Entries go away once a list shows the object with an
+ * equal or newer utime, or after OM_OVERLAY_TIMEOUT_USEC in case the server
+ * never took the update.
+ */
+typedef struct _om_overlay_entry
+{
+    om_object_t *object;
+    int64_t sent_utime;
+} om_overlay_entry_t;
+
+static void _om_overlay_entry_free(gpointer data)
+{
+    om_overlay_entry_t *entry = (om_overlay_entry_t*)data;
+    om_object_t_destroy(entry->object);
+    free(entry);
 }
 
-void om_destroy(ObjectWorldModel *om)
+/**
+ * Remembers obj as sent. The mutex must be held.
+ */
+static void _om_overlay_record(ObjectWorldModel *om, const om_object_t *obj)
 {
-    if (!om) return;
+    if (!om->overlay)
+        return;
+    om_overlay_entry_t *entry =
+        (om_overlay_entry_t*)malloc(sizeof(om_overlay_entry_t));
+    entry->object = om_object_t_copy(obj);
+    entry->sent_utime = bot_timestamp_now();
+    g_hash_table_replace(om->overlay, &entry->object->id, entry);
+}
 
-    DBG("Freeing pose\n");
-    if (om->pose) bot_core_pose_t_destroy(om->pose);
-    DBG("Freeing object list\n");
-    if (om->ol) om_object_list_t_destroy(om->ol);
+static gboolean _om_overlay_is_stale(const om_overlay_entry_t *entry,
+                                     const om_object_t *server_obj,
+                                     int64_t now)
+{
+    return (server_obj && server_obj->utime >= entry->object->utime) ||
+        now - entry->sent_utime > OM_OVERLAY_TIMEOUT_USEC;
+}
 
-    if (om->lcm)
+static gboolean _om_overlay_prune_entry(gpointer key, gpointer value,
+                                        gpointer user)
+{
+    om_snapshot_t *snap = (om_snapshot_t*)user;
+    om_overlay_entry_t *entry = (om_overlay_entry_t*)value;
+    int i = om_object_index_lookup(snap->index, entry->object->id);
+    return _om_overlay_is_stale(entry, i >= 0 ? &snap->ol->objects[i] : NULL,
+                                bot_timestamp_now());
+}
+
+void om_set_overlay(ObjectWorldModel *om, gboolean enable)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    if (enable && !om->overlay)
+        om->overlay = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                            NULL, _om_overlay_entry_free);
+    else if (!enable && om->overlay)
     {
-        DBG("Freeing pose subscription\n");
-        if (om->pose_sub) bot_core_pose_t_unsubscribe(om->lcm, om->pose_sub);
-        DBG("Freeing object list subscription\n");
-        if (om->ol_sub) om_object_list_t_unsubscribe(om->lcm, om->ol_sub);
-        DBG("Freeing lcm\n");
+        g_hash_table_destroy(om->overlay);
+        om->overlay = NULL;
     }
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Publishes obj on channel as a list of its own, unless a batch is open or
+ * async publishing is on.
+ */
+static int _om_send_object(ObjectWorldModel *om, const char *channel,
+                           om_object_t *obj, int64_t list_utime)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_overlay_record(om, obj);
+    if (om->batching)
+    {
+        om_batch_out_t out = { 0 };
+        _om_batch_add(om, obj, &out);
+        g_static_rec_mutex_unlock(&om->mutex);
+        return _om_batch_send(om, &out);
+    }
+    om_publish_queue_t *queue = _om_publish_queue_enter(om);
+    g_static_rec_mutex_unlock(&om->mutex);
+    if (queue)
+    {
+        om_publish_queue_push(queue, obj);
+        _om_publish_queue_leave(om);
+        return 0;
+    }
+
+    om_object_list_t list =
+    {
+        .utime = list_utime,
+        .num_objects = 1,
+        .objects = obj
+    };
+    return om_object_list_t_publish(om->lcm, channel, &list);
+}
+
+void om_begin_batch(ObjectWorldModel *om)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    om->batching = TRUE;
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+int om_batch_update(ObjectWorldModel *om, const om_object_t *obj)
+{
+    return _om_send_object(om, OBJECT_UPDATE_CHANNEL, (om_object_t*)obj,
+                           bot_timestamp_now());
+}
+
+int om_commit_batch(ObjectWorldModel *om)
+{
+    om_batch_out_t out = { 0 };
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_batch_take(om, &out);
+    om->batching = FALSE;
+    g_static_rec_mutex_unlock(&om->mutex);
+    return _om_batch_send(om, &out);
+}
+
+void om_set_batch_autoflush(ObjectWorldModel *om, int max_objects,
+                            int max_delay_ms)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    om->batch_max_objects = max_objects;
+    om->batch_max_delay_ms = max_delay_ms;
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+int om_add_object(ObjectWorldModel *om, om_object_t *obj)
+{
+    // set the object id if not set by the calling process
+    // (object ids required to be > 1 (or is it 0?))
+    _om_assign_ids(om, obj, 1);
+
+    return _om_send_object(om, OBJECT_ADD_CHANNEL, obj, obj->utime);
+}
+
+int om_add_objects(ObjectWorldModel *om, om_object_t *objects, int num_objects)
+{
+    _om_assign_ids(om, objects, num_objects);
+
+    g_static_rec_mutex_lock(&om->mutex);
+    int rc = 0;
+    om_batch_out_t out = { 0 };
+    for (int i = 0; i < num_objects; i++)
+    {
+        _om_overlay_record(om, &objects[i]);
+        if (om->batching)
+            _om_batch_add(om, &objects[i], &out);
+    }
+    om_publish_queue_t *queue = NULL;
+    if (!om->batching && num_objects &&
+        !(queue = _om_publish_queue_enter(om)))
+        rc = _om_publish_objects(om, OBJECT_ADD_CHANNEL, objects, num_objects,
+                                 bot_timestamp_now());
+    g_static_rec_mutex_unlock(&om->mutex);
+
+    if (queue)
+    {
+        for (int i = 0; i < num_objects; i++)
+            om_publish_queue_push(queue, &objects[i]);
+        _om_publish_queue_leave(om);
+    }
+    if (_om_batch_send(om, &out) < 0)
+        rc = -1;
+    return rc;
+}
+void om_update_object(ObjectWorldModel *om, om_object_t *obj)
+{
+    _om_send_object(om, OBJECT_UPDATE_CHANNEL, obj, bot_timestamp_now());
+}
+
+
+void om_update_object_pos(ObjectWorldModel *om, om_object_t *obj,
+        double x, double y, double z)
+{
+    obj->pos[0] = x;
+    obj->pos[1] = y;
+    obj->pos[2] = z;
+    // the server ignores updates that are not newer than what it has
+    obj->utime = bot_timestamp_now();
+    
+    _om_send_object(om, OBJECT_UPDATE_CHANNEL, obj, bot_timestamp_now());
+}
+
+void om_update_object_pos_by_id(ObjectWorldModel *om, int64_t id,
+        double x, double y, double z)
+{
+    om_object_t *obj = om_get_object_by_id(om, id);
+    om_update_object_pos(om, obj, x, y, z);
+    om_object_t_destroy(obj);
+}
+
+void om_move_object_by_by_id(ObjectWorldModel *om, int64_t id,
+        double dx, double dy, double dz)
+{
+    om_object_patch_t patch =
+    {
+        .utime = bot_timestamp_now(),
+        .id = id,
+        .fields = OM_OBJECT_PATCH_T_POS_DELTA,
+        .pos = { dx, dy, dz },
+        .orientation = { 1, 0, 0, 0 },
+        .label = ""
+    };
+    om_patch_object(om, &patch);
+}
+
+int om_patch_object(ObjectWorldModel *om, const om_object_patch_t *patch)
+{
+    return om_object_patch_t_publish(om->lcm, OBJECT_PATCH_CHANNEL, patch);
+}
+
+int om_attach_object(ObjectWorldModel *om, int64_t id, int64_t parent_id)
+{
+    om_object_patch_t patch =
+    {
+        .utime = bot_timestamp_now(),
+        .id = id,
+        .fields = OM_OBJECT_PATCH_T_PARENT,
+        .orientation = { 1, 0, 0, 0 },
+        .label = "",
+        .parent_id = parent_id
+    };
+    return om_patch_object(om, &patch);
+}
+
+int om_set_region(ObjectWorldModel *om, const om_region_t *region)
+{
+    return om_region_t_publish(om->lcm, OM_REGION_CHANNEL, region);
+}
+
+/**
+ * Maps the shared memory segment om->shm_name, replacing any previous mapping.
+ */
+static int _om_shm_open(ObjectWorldModel *om)
+{
+    int fd = shm_open(om->shm_name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(om_shm_header_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == addr)
+        return -1;
+
+    const om_shm_header_t *hdr = (const om_shm_header_t*)addr;
+    if (hdr->magic != OM_SHM_MAGIC ||
+        hdr->layout_version != OM_SHM_LAYOUT_VERSION ||
+        st.st_size < om_shm_segment_size(hdr->max_objects, hdr->label_capacity))
+    {
+        munmap(addr, st.st_size);
+        return -1;
+    }
+
+    if (om->shm) munmap((void*)om->shm, om->shm_size);
+    om->shm = hdr;
+    om->shm_size = st.st_size;
+    om->shm_ino = st.st_ino;
+    return 0;
+}
+
+/**
+ * Makes sure om->shm maps the segment the server currently writes to. The
+ * server marks a segment stale when it replaces it, but a restarted server
+ * cannot, so every so often we also compare the inode behind the name.
+ */
+static gboolean _om_shm_check(ObjectWorldModel *om)
+{
+    int64_t now = bot_timestamp_now();
+    if (om->shm && !om->shm->stale &&
+        now - om->shm_check_utime < OM_SHM_RECHECK_USEC)
+        return TRUE;
+    om->shm_check_utime = now;
+
+    if (om->shm && !om->shm->stale)
+    {
+        struct stat st;
+        int fd = shm_open(om->shm_name, O_RDONLY, 0);
+        if (fd < 0)
+            return TRUE; // server gone, keep serving the last world
+        int same = (fstat(fd, &st) == 0 && st.st_ino == om->shm_ino);
+        close(fd);
+        if (same)
+            return TRUE;
+    }
+    _om_shm_open(om);
+    return NULL != om->shm;
+}
+
+/**
+ * Fills obj from a shared memory record, including a copy of its label.
+ */
+static void _om_shm_record_to_object(const om_shm_header_t *hdr,
+                                     om_shm_buffer_t *buf,
+                                     const om_shm_object_t *rec,
+                                     om_object_t *obj)
+{
+    obj->utime = rec->utime;
+    obj->id = rec->id;
+    memcpy(obj->pos, rec->pos, sizeof(obj->pos));
+    memcpy(obj->orientation, rec->orientation, sizeof(obj->orientation));
+    memcpy(obj->bbox_min, rec->bbox_min, sizeof(obj->bbox_min));
+    memcpy(obj->bbox_max, rec->bbox_max, sizeof(obj->bbox_max));
+    obj->object_type = rec->object_type;
+
+    // the record may be torn, never trust the offset
+    uint32_t offset = MIN(rec->label_offset, hdr->label_capacity);
+    obj->label = strndup(om_shm_buffer_labels(hdr, buf) + offset,
+                         hdr->label_capacity - offset);
+}
+
+/**
+ * Binary search for id in the active shared memory buffer, reading the
+ * records in place and copying out only the match.
+ */
+static om_object_t *_om_shm_get_object_by_id(ObjectWorldModel *om, int64_t id)
+{
+    if (!_om_shm_check(om))
+        return NULL;
+
+    const om_shm_header_t *hdr = om->shm;
+    for (;;)
+    {
+        om_shm_buffer_t *buf = om_shm_buffer(hdr, hdr->active & 1);
+        uint32_t seq = buf->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+
+        const om_shm_object_t *recs = om_shm_buffer_objects(buf);
+        uint32_t lo = 0, hi = MIN(buf->num_objects, hdr->max_objects);
+        uint32_t n = hi;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (recs[mid].id < id)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        om_object_t *rtn = NULL;
+        if (lo < n && recs[lo].id == id)
+        {
+            rtn = (om_object_t*)calloc(1, sizeof(om_object_t));
+            _om_shm_record_to_object(hdr, buf, &recs[lo], rtn);
+        }
+
+        __sync_synchronize();
+        if (buf->seq == seq)
+            return rtn;
+
+        // the server wrote over this buffer while we were reading it
+        if (rtn) om_object_t_destroy(rtn);
+    }
+}
+
+static int64_t _om_shm_get_object_id_by_pos(ObjectWorldModel *om,
+                                            double x, double y, double z,
+                                            double max_dist, double *dist)
+{
+    *dist = DBL_MAX;
+    if (!_om_shm_check(om))
+        return -1;
+
+    const om_shm_header_t *hdr = om->shm;
+    for (;;)
+    {
+        om_shm_buffer_t *buf = om_shm_buffer(hdr, hdr->active & 1);
+        uint32_t seq = buf->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+
+        const om_shm_object_t *recs = om_shm_buffer_objects(buf);
+        uint32_t n = MIN(buf->num_objects, hdr->max_objects);
+        double min_dist = max_dist;
+        int64_t closest_id = -1;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            double d = sqrt (bot_sq(recs[i].pos[0]-x) + bot_sq(recs[i].pos[1]-y)
+                             + bot_sq(recs[i].pos[2]-z));
+            if (d < min_dist) {
+                min_dist = d;
+                closest_id = recs[i].id;
+            }
+        }
+
+        __sync_synchronize();
+        if (buf->seq == seq)
+        {
+            *dist = min_dist;
+            return closest_id;
+        }
+    }
+}
+
+/**
+ * Copies the positions in the active shared memory buffer into points.
+ * Returns the number of points; *utime is set to that of the buffer. If
+ * the buffer is still the one written at have_utime, copies nothing and
+ * returns -1.
+ */
+static int _om_shm_get_points(ObjectWorldModel *om, int64_t have_utime,
+                              om_kdtree_point_t **points, int64_t *utime)
+{
+    *points = NULL;
+    if (!_om_shm_check(om))
+        return 0;
+
+    const om_shm_header_t *hdr = om->shm;
+    for (;;)
+    {
+        om_shm_buffer_t *buf = om_shm_buffer(hdr, hdr->active & 1);
+        uint32_t seq = buf->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+        if (buf->utime == have_utime)
+            break;
+
+        const om_shm_object_t *recs = om_shm_buffer_objects(buf);
+        uint32_t n = MIN(buf->num_objects, hdr->max_objects);
+        *points = (om_kdtree_point_t*)realloc(*points,
+                                              (n+1) * sizeof(om_kdtree_point_t));
+        for (uint32_t i = 0; i < n; i++)
+        {
+            memcpy((*points)[i].pos, recs[i].pos, sizeof(recs[i].pos));
+            (*points)[i].id = recs[i].id;
+            (*points)[i].object_type = recs[i].object_type;
+        }
+        *utime = buf->utime;
+
+        __sync_synchronize();
+        if (buf->seq == seq)
+            return n;
+    }
+    // unchanged, maybe only after a torn copy
+    free(*points);
+    *points = NULL;
+    return -1;
+}
+
+/**
+ * Returns the k-d tree over the current world, (re)building it if the world
+ * changed since the last query. The mutex must be held.
+ */
+static om_kdtree_t *_om_get_kdtree(ObjectWorldModel *om)
+{
+    _om_lazy_decode(om);
+    if (om->shm_name)
+    {
+        // bot_timestamp_now() never gives -1, so a dirty tree always copies
+        om_kdtree_point_t *points;
+        int64_t utime;
+        int n = _om_shm_get_points(om, om->kdtree_dirty ? -1 : om->kdtree_shm_utime,
+                                   &points, &utime);
+        if (points)
+        {
+            om_kdtree_build(om->kdtree, points, n);
+            om->kdtree_shm_utime = utime;
+            om->kdtree_dirty = FALSE;
+        }
+        return om->kdtree;
+    }
+
+    if (om->kdtree_dirty)
+    {
+        int n = om->ol->num_objects;
+        om_kdtree_point_t *points =
+            (om_kdtree_point_t*)malloc((n+1) * sizeof(om_kdtree_point_t));
+        for (int i = 0; i < n; i++)
+        {
+            memcpy(points[i].pos, om->ol->objects[i].pos, sizeof(points[i].pos));
+            points[i].id = om->ol->objects[i].id;
+            points[i].object_type = om->ol->objects[i].object_type;
+        }
+        om_kdtree_build(om->kdtree, points, n);
+        om->kdtree_dirty = FALSE;
+    }
+    return om->kdtree;
+}
+
+/**
+ * Copies the boxes in the active shared memory buffer into boxes, like
+ * _om_shm_get_points().
+ */
+static int _om_shm_get_boxes(ObjectWorldModel *om, int64_t have_utime,
+                             om_bvh_box_t **boxes, int64_t *utime)
+{
+    *boxes = NULL;
+    if (!_om_shm_check(om))
+        return 0;
+
+    const om_shm_header_t *hdr = om->shm;
+    for (;;)
+    {
+        om_shm_buffer_t *buf = om_shm_buffer(hdr, hdr->active & 1);
+        uint32_t seq = buf->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+        if (buf->utime == have_utime)
+            break;
+
+        const om_shm_object_t *recs = om_shm_buffer_objects(buf);
+        uint32_t n = MIN(buf->num_objects, hdr->max_objects);
+        *boxes = (om_bvh_box_t*)realloc(*boxes, (n+1) * sizeof(om_bvh_box_t));
+        for (uint32_t i = 0; i < n; i++)
+            om_bvh_box_set(&(*boxes)[i], recs[i].pos, recs[i].orientation,
+                           recs[i].bbox_min, recs[i].bbox_max, recs[i].id);
+        *utime = buf->utime;
+
+        __sync_synchronize();
+        if (buf->seq == seq)
+            return n;
+    }
+    // unchanged, maybe only after a torn copy
+    free(*boxes);
+    *boxes = NULL;
+    return -1;
+}
+
+/**
+ * Returns the bounding volume hierarchy over the current world, (re)built
+ * like the k-d tree. The mutex must be held.
+ */
+static om_bvh_t *_om_get_bvh(ObjectWorldModel *om)
+{
+    _om_lazy_decode(om);
+    if (om->shm_name)
+    {
+        om_bvh_box_t *boxes;
+        int64_t utime;
+        int n = _om_shm_get_boxes(om, om->bvh_dirty ? -1 : om->bvh_shm_utime,
+                                  &boxes, &utime);
+        if (boxes)
+        {
+            om_bvh_build(om->bvh, boxes, n);
+            om->bvh_shm_utime = utime;
+            om->bvh_dirty = FALSE;
+        }
+        return om->bvh;
+    }
+
+    if (om->bvh_dirty)
+    {
+        int n = om->ol->num_objects;
+        om_bvh_box_t *boxes = (om_bvh_box_t*)malloc((n+1) * sizeof(om_bvh_box_t));
+        for (int i = 0; i < n; i++)
+        {
+            const om_object_t *obj = &om->ol->objects[i];
+            om_bvh_box_set(&boxes[i], obj->pos, obj->orientation,
+                           obj->bbox_min, obj->bbox_max, obj->id);
+        }
+        om_bvh_build(om->bvh, boxes, n);
+        om->bvh_dirty = FALSE;
+    }
+    return om->bvh;
+}
+
+om_object_t *om_get_object_by_id(ObjectWorldModel *om, int64_t id)
+{
+    om_object_t *rtn = NULL;
+    _om_lock_query(om);
+    _om_lazy_decode(om);
+    if (om->shm_name)
+        rtn = _om_shm_get_object_by_id(om, id);
+    else if (NULL != om->ol)
+    {
+        int i = om_object_index_lookup(om->snapshots.current->index, id);
+        if (i >= 0)
+            rtn = om_object_t_copy(&om->ol->objects[i]);
+    }
+
+    // our own update wins until the server shows it
+    om_overlay_entry_t *entry =
+        om->overlay ? g_hash_table_lookup(om->overlay, &id) : NULL;
+    if (entry && _om_overlay_is_stale(entry, rtn, bot_timestamp_now()))
+        g_hash_table_remove(om->overlay, &id);
+    else if (entry)
+    {
+        if (rtn) om_object_t_destroy(rtn);
+        rtn = om_object_t_copy(entry->object);
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+    //ERR("No object with ID %"PRId64" exists!\n", id);
+
+    return rtn;
+}
+
+
+int64_t om_get_object_id_by_pos(ObjectWorldModel *om, double x, double y,
+                                double z, double *dist)
+{
+    _om_lock_query(om);
+    _om_lazy_decode(om);
+
+    if (om->shm_name)
+    {
+        int64_t rtn = _om_shm_get_object_id_by_pos(om, x, y, z,
+                                                   OM_NEAREST_MAX_DIST, dist);
+        g_static_rec_mutex_unlock(&om->mutex);
+        return rtn;
+    }
+
+    if (NULL != om->ol) 
+    {
+        // no point in considering objects farther than OM_NEAREST_MAX_DIST
+        double pt[3] = { x, y, z };
+        int64_t closest_id = om_kdtree_nearest_of_type(_om_get_kdtree(om), pt,
+                                                       -1, OM_NEAREST_MAX_DIST,
+                                                       dist);
+        if (closest_id < 0)
+            *dist = OM_NEAREST_MAX_DIST;
+        g_static_rec_mutex_unlock(&om->mutex);
+        return closest_id;
+    }
+    else
+    {
+        *dist = DBL_MAX;
+        g_static_rec_mutex_unlock(&om->mutex);
+        return -1;
+    }   
+}
+
+int om_get_k_nearest_objects(ObjectWorldModel *om, double x, double y,
+                             double z, int k, double max_dist, int64_t *ids,
+                             double *dists)
+{
+    double pt[3] = { x, y, z };
+    _om_lock_query(om);
+    int n = om_kdtree_k_nearest(_om_get_kdtree(om), pt, k, max_dist, ids, dists);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+int64_t om_get_nearest_object_of_type(ObjectWorldModel *om, double x, double y,
+                                      double z, int16_t object_type,
+                                      double max_dist, double *dist)
+{
+    double pt[3] = { x, y, z };
+    _om_lock_query(om);
+    int64_t id = om_kdtree_nearest_of_type(_om_get_kdtree(om), pt, object_type,
+                                           max_dist, dist);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return id;
+}
+
+int om_get_objects_in_radius(ObjectWorldModel *om, double x, double y,
+                             double z, double radius, int64_t **ids)
+{
+    double pt[3] = { x, y, z };
+    _om_lock_query(om);
+    int n = om_kdtree_radius(_om_get_kdtree(om), pt, radius, ids);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+/**
+ * Brings the type and label index up to date with the shared memory world.
+ */
+static void _om_shm_sync_attr_index(ObjectWorldModel *om)
+{
+    if (!_om_shm_check(om))
+        return;
+
+    const om_shm_header_t *hdr = om->shm;
+    om_object_t *objects = NULL;
+    for (;;)
+    {
+        om_shm_buffer_t *buf = om_shm_buffer(hdr, hdr->active & 1);
+        uint32_t seq = buf->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+        if (buf->utime == om->attr_shm_utime && !om->attr_dirty)
+            break;
+
+        const om_shm_object_t *recs = om_shm_buffer_objects(buf);
+        uint32_t n = MIN(buf->num_objects, hdr->max_objects);
+        objects = (om_object_t*)realloc(objects, (n+1) * sizeof(om_object_t));
+        for (uint32_t i = 0; i < n; i++)
+            _om_shm_record_to_object(hdr, buf, &recs[i], &objects[i]);
+        int64_t utime = buf->utime;
+
+        __sync_synchronize();
+        gboolean intact = buf->seq == seq;
+        if (intact)
+            om_attr_index_sync(om->attr_index, objects, n);
+        for (uint32_t i = 0; i < n; i++)
+            free(objects[i].label);
+        if (intact)
+        {
+            om->attr_shm_utime = utime;
+            om->attr_dirty = FALSE;
+            break;
+        }
+    }
+    free(objects);
+}
+
+/**
+ * Returns the type and label index, brought up to date with the current
+ * world if it changed since the last query. The mutex must be held.
+ */
+static const om_attr_index_t *_om_get_attr_index(ObjectWorldModel *om)
+{
+    _om_lazy_decode(om);
+    if (om->shm_name)
+        _om_shm_sync_attr_index(om);
+    else if (om->attr_dirty)
+    {
+        om_attr_index_sync(om->attr_index, om->ol->objects, om->ol->num_objects);
+        om->attr_dirty = FALSE;
+    }
+    return om->attr_index;
+}
+
+int om_get_objects_by_type(ObjectWorldModel *om, int16_t object_type,
+                           int64_t **ids)
+{
+    _om_lock_query(om);
+    int n = om_attr_index_by_type(_om_get_attr_index(om), object_type, ids);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+om_object_t *om_get_object_by_label(ObjectWorldModel *om, const char *label)
+{
+    _om_lock_query(om);
+    int64_t id = om_attr_index_by_label(_om_get_attr_index(om), label);
+    om_object_t *obj = id >= 0 ? om_get_object_by_id(om, id) : NULL;
+    g_static_rec_mutex_unlock(&om->mutex);
+    return obj;
+}
+
+int om_get_objects_by_label_prefix(ObjectWorldModel *om, const char *prefix,
+                                   int64_t **ids)
+{
+    _om_lock_query(om);
+    int n = om_attr_index_by_label_prefix(_om_get_attr_index(om), prefix, ids);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+int om_get_objects_in_box(ObjectWorldModel *om, const double min[3],
+                          const double max[3], int64_t **ids)
+{
+    _om_lock_query(om);
+    int n = om_kdtree_box(_om_get_kdtree(om), min, max, ids);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+int64_t om_raycast(ObjectWorldModel *om, const double origin[3],
+                   const double dir[3], double max_dist, double *dist)
+{
+    _om_lock_query(om);
+    int64_t id = om_bvh_raycast(_om_get_bvh(om), origin, dir, max_dist, dist);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return id;
+}
+
+/*
+ * Cameras for om_get_objects_in_view(), by name in om->hash.
+ */
+typedef struct _om_camera
+{
+    BotCamTrans *camtrans;
+    char *coord_frame;
+} om_camera_t;
+
+static void _om_camera_free(gpointer data)
+{
+    om_camera_t *cam = (om_camera_t*)data;
+    bot_camtrans_destroy(cam->camtrans);
+    free(cam->coord_frame);
+    free(cam);
+}
+
+/**
+ * Returns the camera called name, reading its calibration from param the
+ * first time. The mutex must be held.
+ */
+static om_camera_t *_om_get_camera(ObjectWorldModel *om, const char *name)
+{
+    om_camera_t *cam = (om_camera_t*)g_hash_table_lookup(om->hash, name);
+    if (cam)
+        return cam;
+
+    BotCamTrans *camtrans = bot_param_get_new_camtrans(om->param, name);
+    char *coord_frame = bot_param_get_camera_coord_frame(om->param, name);
+    if (!camtrans || !coord_frame)
+    {
+        ERR("Could not get the calibration of camera %s\n", name);
+        if (camtrans) bot_camtrans_destroy(camtrans);
+        free(coord_frame);
+        return NULL;
+    }
+    cam = (om_camera_t*)malloc(sizeof(om_camera_t));
+    cam->camtrans = camtrans;
+    cam->coord_frame = coord_frame;
+    g_hash_table_insert(om->hash, strdup(name), cam);
+    return cam;
+}
+
+/**
+ * Projects the corners of box, in camera coordinates, into the image.
+ * Edges crossing the near plane are cut there. Returns FALSE if no part
+ * of the box is in front of the camera and inside the image.
+ */
+static gboolean _om_project_box(const BotCamTrans *camtrans,
+                                const double corners[8][3], double bbox[4])
+{
+    double width = bot_camtrans_get_width(camtrans);
+    double height = bot_camtrans_get_height(camtrans);
+    bbox[0] = bbox[1] = DBL_MAX;
+    bbox[2] = bbox[3] = -DBL_MAX;
+
+    double points[8 + 12][3];
+    int n = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (corners[i][2] >= OM_VIEW_NEAR_PLANE)
+            memcpy(points[n++], corners[i], sizeof(points[0]));
+        // corners i and j = i with one bit flipped share an edge
+        for (int bit = 1; bit < 8; bit <<= 1)
+        {
+            int j = i ^ bit;
+            if (j < i)
+                continue;
+            double za = corners[i][2] - OM_VIEW_NEAR_PLANE;
+            double zb = corners[j][2] - OM_VIEW_NEAR_PLANE;
+            if ((za < 0) == (zb < 0))
+                continue;
+            double t = za / (za - zb);
+            for (int k = 0; k < 3; k++)
+                points[n][k] = corners[i][k] + t * (corners[j][k] - corners[i][k]);
+            points[n++][2] = OM_VIEW_NEAR_PLANE;
+        }
+    }
+
+    gboolean projected = FALSE;
+    for (int i = 0; i < n; i++)
+    {
+        double uvw[3];
+        if (bot_camtrans_project_point(camtrans, points[i], uvw) < 0)
+            continue;
+        projected = TRUE;
+        bbox[0] = fmin(bbox[0], uvw[0]);
+        bbox[1] = fmin(bbox[1], uvw[1]);
+        bbox[2] = fmax(bbox[2], uvw[0]);
+        bbox[3] = fmax(bbox[3], uvw[1]);
+    }
+    if (!projected || bbox[2] < 0 || bbox[3] < 0 ||
+        bbox[0] > width || bbox[1] > height)
+        return FALSE;
+
+    bbox[0] = fmax(bbox[0], 0);
+    bbox[1] = fmax(bbox[1], 0);
+    bbox[2] = fmin(bbox[2], width);
+    bbox[3] = fmin(bbox[3], height);
+    return TRUE;
+}
+
+static int _om_view_object_compare(const void *a, const void *b)
+{
+    double da = ((const om_view_object_t*)a)->dist;
+    double db = ((const om_view_object_t*)b)->dist;
+    return (da > db) - (da < db);
+}
+
+int om_get_objects_in_view(ObjectWorldModel *om, const char *camera_name,
+                           double max_range, om_view_object_t **objects)
+{
+    *objects = NULL;
+    _om_lock_query(om);
+    om_camera_t *cam = _om_get_camera(om, camera_name);
+    // our own, not the global one: lcm and param may be private to this
+    // client and go away with it
+    if (!om->frames)
+        om->frames = bot_frames_new(om->lcm, om->param);
+
+    BotTrans cam_to_local, local_to_cam;
+    if (!cam || !om->frames ||
+        !bot_frames_get_trans(om->frames, cam->coord_frame, "local",
+                              &cam_to_local))
+    {
+        g_static_rec_mutex_unlock(&om->mutex);
+        return -1;
+    }
+    bot_trans_copy(&local_to_cam, &cam_to_local);
+    bot_trans_invert(&local_to_cam);
+
+    // only objects around the camera can be in view
+    int64_t *ids;
+    int num_ids = om_kdtree_radius(_om_get_kdtree(om), cam_to_local.trans_vec,
+                                   max_range, &ids);
+
+    om_view_object_t *visible =
+        (om_view_object_t*)malloc((num_ids + 1) * sizeof(om_view_object_t));
+    int n = 0;
+    for (int i = 0; i < num_ids; i++)
+    {
+        const om_object_t *obj = NULL;
+        om_object_t *copy = NULL;
+        if (om->shm_name)
+            obj = copy = _om_shm_get_object_by_id(om, ids[i]);
+        else
+        {
+            int idx = om_object_index_lookup(om->snapshots.current->index, ids[i]);
+            obj = idx >= 0 ? &om->ol->objects[idx] : NULL;
+        }
+        if (!obj)
+            continue;
+
+        om_bvh_box_t box;
+        om_bvh_box_set(&box, obj->pos, obj->orientation, obj->bbox_min,
+                       obj->bbox_max, obj->id);
+        double corners[8][3];
+        for (int c = 0; c < 8; c++)
+        {
+            double local[3], world[3];
+            for (int k = 0; k < 3; k++)
+                local[k] = (c & (1 << k)) ? box.max[k] : box.min[k];
+            for (int k = 0; k < 3; k++)
+                world[k] = box.pos[k] + box.rot[3*k] * local[0] +
+                    box.rot[3*k+1] * local[1] + box.rot[3*k+2] * local[2];
+            bot_trans_apply_vec(&local_to_cam, world, corners[c]);
+        }
+
+        om_view_object_t *v = &visible[n];
+        if (_om_project_box(cam->camtrans, (const double (*)[3])corners, v->bbox))
+        {
+            double cam_pos[3];
+            bot_trans_apply_vec(&local_to_cam, obj->pos, cam_pos);
+            v->id = obj->id;
+            v->dist = sqrt(cam_pos[0]*cam_pos[0] + cam_pos[1]*cam_pos[1] +
+                           cam_pos[2]*cam_pos[2]);
+            n++;
+        }
+        if (copy) om_object_t_destroy(copy);
+    }
+    free(ids);
+    g_static_rec_mutex_unlock(&om->mutex);
+
+    qsort(visible, n, sizeof(om_view_object_t), _om_view_object_compare);
+    *objects = visible;
+    return n;
+}
+
+struct _om_changes_subscription
+{
+    om_change_tracker_t *tracker;
+    om_changes_handler_t handler;
+    void *user;
+};
+
+/**
+ * Tells every change subscriber what changed from old to snap. The mutex
+ * must be held.
+ */
+static void _om_notify_changes(ObjectWorldModel *om, om_snapshot_t *old,
+                               om_snapshot_t *snap)
+{
+    for (GSList *iter = om->change_subs; iter; iter = iter->next)
+    {
+        om_changes_subscription_t *sub = (om_changes_subscription_t*)iter->data;
+        const om_change_t *changes;
+        int n = om_change_tracker_update(sub->tracker, snap->ol->objects,
+                                         snap->ol->num_objects,
+                                         old ? old->ol->objects : NULL,
+                                         old ? old->index : NULL, &changes);
+        if (n > 0)
+            sub->handler(om, changes, n, sub->user);
+    }
+}
+
+om_changes_subscription_t *om_subscribe_changes(ObjectWorldModel *om,
+                                                double min_translation,
+                                                double min_rotation,
+                                                om_changes_handler_t handler,
+                                                void *user)
+{
+    om_changes_subscription_t *sub = (om_changes_subscription_t*)
+        calloc(1, sizeof(om_changes_subscription_t));
+    sub->tracker = om_change_tracker_new(min_translation, min_rotation);
+    sub->handler = handler;
+    sub->user = user;
+
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_lazy_decode(om);
+    // bring the tracker up to date quietly, later calls report changes only
+    const om_change_t *changes;
+    om_change_tracker_update(sub->tracker, om->ol->objects, om->ol->num_objects,
+                             NULL, NULL, &changes);
+    om->change_subs = g_slist_append(om->change_subs, sub);
+    g_static_rec_mutex_unlock(&om->mutex);
+    return sub;
+}
+
+void om_unsubscribe_changes(ObjectWorldModel *om, om_changes_subscription_t *sub)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    om->change_subs = g_slist_remove(om->change_subs, sub);
+    g_static_rec_mutex_unlock(&om->mutex);
+    om_change_tracker_destroy(sub->tracker);
+    free(sub);
+}
+
+/**
+ * Makes snap, filled in by the caller, the current world. The mutex must
+ * be held.
+ */
+static void _om_publish_snapshot(ObjectWorldModel *om, om_snapshot_t *snap,
+                                 int64_t version, int64_t epoch,
+                                 int64_t decode_start)
+{
+    om_object_index_build(snap->index, snap->ol->objects, snap->ol->num_objects);
+    snap->version = version;
+    _om_stats_sample(&om->stats_decode, bot_timestamp_now() - decode_start);
+    if (om->stats_last_receive)
+        om->stats_latency = om->stats_last_receive - snap->ol->utime;
+
+    om_snapshot_t *old = om->snapshots.current;
+    om_snapshot_slot_publish(&om->snapshots, snap);
+    om->ol = snap->ol;
+    om->version = version;
+    om->epoch = epoch;
+    om->kdtree_dirty = TRUE;  // rebuilt on the next geometric query
+    om->bvh_dirty = TRUE;
+    om->attr_dirty = TRUE;
+    om->nearby_scanned = FALSE;
+    if (om->overlay)
+        g_hash_table_foreach_remove(om->overlay, _om_overlay_prune_entry, snap);
+
+    _om_notify_changes(om, old, snap);
+    _om_nearby_collect(om);
+
+    g_mutex_lock(om->wait_mutex);
+    om->update_count++;
+    g_cond_broadcast(om->update_cond);
+    g_mutex_unlock(om->wait_mutex);
+}
+
+/**
+ * Makes a copy of list the current world. The mutex must be held.
+ */
+static void _om_set_object_list(ObjectWorldModel *om,
+                                const om_object_list_t *list, int64_t version,
+                                int64_t epoch)
+{
+    int64_t start = bot_timestamp_now();
+    om_snapshot_t *snap = om_snapshot_pool_get(om->snapshot_pool);
+    om_list_buffer_copy(snap->buffer, list);
+    _om_publish_snapshot(om, snap, version, epoch, start);
+}
+
+const om_snapshot_t *om_acquire_snapshot(ObjectWorldModel *om)
+{
+    if (om->shm_name)
+        return NULL;
+
+    if (g_atomic_int_get(&om->lazy_pending))
+    {
+        g_static_rec_mutex_lock(&om->mutex);
+        _om_lazy_decode(om);
+        g_static_rec_mutex_unlock(&om->mutex);
+    }
+
+    return om_snapshot_slot_acquire(&om->snapshots);
+}
+
+void om_release_snapshot(const om_snapshot_t *snap)
+{
+    if (snap)
+        om_snapshot_unref((om_snapshot_t*)snap);
+}
+
+const om_object_t *om_snapshot_get_objects(const om_snapshot_t *snap,
+                                           int *num_objects)
+{
+    *num_objects = snap->ol->num_objects;
+    return snap->ol->objects;
+}
+
+const om_object_t *om_snapshot_get_object_by_id(const om_snapshot_t *snap,
+                                                int64_t id)
+{
+    int i = om_object_index_lookup(snap->index, id);
+    return i >= 0 ? &snap->ol->objects[i] : NULL;
+}
+
+int64_t om_snapshot_get_utime(const om_snapshot_t *snap)
+{
+    return snap->ol->utime;
+}
+
+int64_t om_snapshot_get_version(const om_snapshot_t *snap)
+{
+    return snap->version;
+}
+
+/**
+ * Decodes an encoded object list straight into a recycled snapshot rather
+ * than through a typed subscription, which would decode into a fresh
+ * message every time. The mutex must be held.
+ */
+static void _om_decode_object_list(ObjectWorldModel *om, const void *data,
+                                   int size)
+{
+    int64_t start = bot_timestamp_now();
+    om_snapshot_t *snap = om_snapshot_pool_get(om->snapshot_pool);
+    if (om_list_buffer_decode(snap->buffer, data, size) < 0)
+    {
+        ERR("Could not decode message on %s\n", OM_OL_CHANNEL);
+        om_snapshot_unref(snap);
+    }
+    // a sync answer may already be newer than a list still in flight
+    else if (snap->ol->utime < om->ol->utime)
+        om_snapshot_unref(snap);
+    else
+        // periodic lists don't carry the server version
+        _om_publish_snapshot(om, snap, 0, 0, start);
+}
+
+/**
+ * Decodes the object list kept by lazy mode, if a new one came in since
+ * the last query. The mutex must be held.
+ */
+static void _om_lazy_decode(ObjectWorldModel *om)
+{
+    if (!om->lazy_pending)
+        return;
+    om->lazy_pending = FALSE;
+    _om_decode_object_list(om, om->lazy_data, om->lazy_size);
+}
+
+void om_set_lazy_decode(ObjectWorldModel *om, gboolean enable)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_lazy_decode(om);
+    om->lazy = enable;
+    if (!enable)
+    {
+        free(om->lazy_data);
+        om->lazy_data = NULL;
+        om->lazy_size = om->lazy_capacity = 0;
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Handles the LCM message that publishes all known objects. In lazy mode
+ * the message is only kept, replacing the last one, until someone asks.
+ */
+void _om_on_object_list(const lcm_recv_buf_t *rbuf, const char *channel,
+                        void *user)
+{
+    //fprintf(stderr,"Received\n");
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_stats_received(om, rbuf->data_size);
+    // change subscribers need every list decoded as it comes
+    if (om->lazy && !om->change_subs)
+    {
+        if (rbuf->data_size > om->lazy_capacity)
+        {
+            free(om->lazy_data);
+            om->lazy_capacity = rbuf->data_size;
+            om->lazy_data = malloc(om->lazy_capacity);
+        }
+        memcpy(om->lazy_data, rbuf->data, rbuf->data_size);
+        om->lazy_size = rbuf->data_size;
+        g_atomic_int_set(&om->lazy_pending, TRUE);
+
+        g_mutex_lock(om->wait_mutex);
+        om->update_count++;
+        g_cond_broadcast(om->update_cond);
+        g_mutex_unlock(om->wait_mutex);
+    }
+    else
+    {
+        om->lazy_pending = FALSE;
+        _om_decode_object_list(om, rbuf->data, rbuf->data_size);
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Handles a piece of an object list too large to be published at once.
+ */
+void _om_on_object_list_chunk(const lcm_recv_buf_t *rbuf, const char *channel,
+                              const om_object_list_chunk_t *msg, void *user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_stats_received(om, rbuf->data_size);
+    if (om->chunk_handler)
+        om->chunk_handler(om, msg, om->chunk_handler_user);
+
+    om_object_list_t *list = om_list_assembler_add(om->assembler, msg);
+    if (list && list->utime >= om->ol->utime)
+        _om_set_object_list(om, list, msg->version, msg->epoch);
+    if (list)
+        om_object_list_t_destroy(list);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+void om_set_chunk_handler(ObjectWorldModel *om, om_chunk_handler_t handler,
+                          void *user)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    om->chunk_handler = handler;
+    om->chunk_handler_user = user;
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Tells if an encoded sync answer, whole or chunked, answers our last sync
+ * request. Both types start with their hash, utime and request_id, so the
+ * answers to other clients are skipped without decoding the world in them.
+ * The mutex must be held.
+ */
+static gboolean _om_is_our_sync(ObjectWorldModel *om,
+                                const lcm_recv_buf_t *rbuf)
+{
+    int64_t request_id;
+    return __int64_t_decode_array(rbuf->data, 16, rbuf->data_size - 16,
+                                  &request_id, 1) > 0 &&
+        request_id == om->sync_request_id;
+}
+
+/**
+ * Handles the server's answer to a sync request. Answers to other clients'
+ * requests are ignored, as is a list older than the one we already have.
+ */
+void _om_on_sync(const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    if (!_om_is_our_sync(om, rbuf))
+    {
+        g_static_rec_mutex_unlock(&om->mutex);
+        return;
+    }
+    _om_stats_received(om, rbuf->data_size);
+
+    om_object_list_sync_t msg;
+    if (om_object_list_sync_t_decode(rbuf->data, 0, rbuf->data_size, &msg) < 0)
+    {
+        ERR("Could not decode message on %s\n", channel);
+        g_static_rec_mutex_unlock(&om->mutex);
+        return;
+    }
+    if (!msg.unchanged && msg.list.utime >= om->ol->utime)
+        _om_set_object_list(om, &msg.list, msg.version, msg.epoch);
+    om_object_list_sync_t_decode_cleanup(&msg);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Handles a piece of a sync answer too large to be sent at once.
+ */
+void _om_on_sync_chunk(const lcm_recv_buf_t *rbuf, const char *channel,
+                       void *user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    if (!_om_is_our_sync(om, rbuf))
+    {
+        g_static_rec_mutex_unlock(&om->mutex);
+        return;
+    }
+    _om_stats_received(om, rbuf->data_size);
+
+    om_object_list_chunk_t msg;
+    if (om_object_list_chunk_t_decode(rbuf->data, 0, rbuf->data_size, &msg) < 0)
+    {
+        ERR("Could not decode message on %s\n", channel);
+        g_static_rec_mutex_unlock(&om->mutex);
+        return;
+    }
+    if (om->chunk_handler)
+        om->chunk_handler(om, &msg, om->chunk_handler_user);
+
+    om_object_list_t *list = om_list_assembler_add(om->sync_assembler, &msg);
+    if (list && list->utime >= om->ol->utime)
+        _om_set_object_list(om, list, msg.version, msg.epoch);
+    if (list)
+        om_object_list_t_destroy(list);
+    om_object_list_chunk_t_decode_cleanup(&msg);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+int om_request_sync(ObjectWorldModel *om)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    om_sync_request_t req =
+    {
+        .utime = bot_timestamp_now(),
+        .request_id = ((int64_t)g_random_int() << 31) ^ g_random_int(),
+        .have_version = om->version,
+        .have_epoch = om->epoch
+    };
+    om->sync_request_id = req.request_id;
+    g_static_rec_mutex_unlock(&om->mutex);
+    return om_sync_request_t_publish(om->lcm, OM_SYNC_REQUEST_CHANNEL, &req);
+}
+
+/*
+ * Nearby objects, see om_set_nearby_radius(). Candidates are the objects
+ * within radius + OM_NEARBY_SLACK of where the robot was when the world
+ * was last scanned; as long as the robot stays within the slack of that
+ * spot, every object within the radius is among them. A new pose then
+ * only filters and sorts the candidates, a new object list or a longer
+ * move scans the world once.
+ */
+typedef struct _om_nearby_candidate
+{
+    int64_t id;
+    double pos[3];
+} om_nearby_candidate_t;
+
+typedef struct _om_nearby
+{
+    int64_t id;
+    double dist;
+} om_nearby_t;
+
+static double _om_dist(const double a[3], const double b[3])
+{
+    double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+static int _om_nearby_compare(const void *a, const void *b)
+{
+    double da = ((const om_nearby_t*)a)->dist;
+    double db = ((const om_nearby_t*)b)->dist;
+    return (da > db) - (da < db);
+}
+
+/**
+ * Rebuilds the sorted nearby objects from the candidates. The mutex must
+ * be held.
+ */
+static void _om_nearby_filter(ObjectWorldModel *om)
+{
+    g_array_set_size(om->nearby, 0);
+    for (int i = 0; i < om->nearby_candidates->len; i++)
+    {
+        om_nearby_candidate_t *c =
+            &g_array_index(om->nearby_candidates, om_nearby_candidate_t, i);
+        om_nearby_t near = { c->id, _om_dist(c->pos, om->pose->pos) };
+        if (near.dist <= om->nearby_radius)
+            g_array_append_val(om->nearby, near);
+    }
+    qsort(om->nearby->data, om->nearby->len, sizeof(om_nearby_t),
+          _om_nearby_compare);
+}
+
+/**
+ * Scans the world for candidates around the robot. The mutex must be held.
+ */
+static void _om_nearby_collect(ObjectWorldModel *om)
+{
+    if (om->nearby_radius <= 0 || !om->pose || om->shm_name)
+        return;
+
+    double reach = om->nearby_radius + OM_NEARBY_SLACK;
+    memcpy(om->nearby_center, om->pose->pos, sizeof(om->nearby_center));
+    g_array_set_size(om->nearby_candidates, 0);
+    for (int i = 0; i < om->ol->num_objects; i++)
+    {
+        const om_object_t *obj = &om->ol->objects[i];
+        if (_om_dist(obj->pos, om->nearby_center) <= reach)
+        {
+            om_nearby_candidate_t c = { .id = obj->id };
+            memcpy(c.pos, obj->pos, sizeof(c.pos));
+            g_array_append_val(om->nearby_candidates, c);
+        }
+    }
+    om->nearby_scanned = TRUE;
+    _om_nearby_filter(om);
+}
+
+/**
+ * Follows the robot to om->pose. The mutex must be held.
+ */
+static void _om_nearby_update_pose(ObjectWorldModel *om)
+{
+    if (om->nearby_radius <= 0 || om->shm_name)
+        return;
+    // an empty neighborhood is as good as any other until the robot moves
+    if (!om->nearby_scanned ||
+        _om_dist(om->pose->pos, om->nearby_center) > OM_NEARBY_SLACK)
+        _om_nearby_collect(om);
+    else
+        _om_nearby_filter(om);
+}
+
+void om_set_nearby_radius(ObjectWorldModel *om, double radius)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_lazy_decode(om);
+    om->nearby_radius = radius;
+    g_array_set_size(om->nearby, 0);
+    g_array_set_size(om->nearby_candidates, 0);
+    om->nearby_scanned = FALSE;
+    _om_nearby_collect(om);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+int om_get_nearby_objects(ObjectWorldModel *om, int max_objects, int64_t *ids,
+                          double *dists)
+{
+    int n = 0;
+    _om_lock_query(om);
+    if (om->nearby_radius <= 0 || !om->pose)
+    {
+        g_static_rec_mutex_unlock(&om->mutex);
+        return 0;
+    }
+
+    if (om->shm_name)
+    {
+        // the shared memory world has no updates to hook into, ask the tree
+        n = om_kdtree_k_nearest(_om_get_kdtree(om), om->pose->pos, max_objects,
+                                om->nearby_radius, ids, dists);
+    }
+    else
+    {
+        _om_lazy_decode(om);
+        n = MIN(max_objects, (int)om->nearby->len);
+        for (int i = 0; i < n; i++)
+        {
+            om_nearby_t *near = &g_array_index(om->nearby, om_nearby_t, i);
+            ids[i] = near->id;
+            if (dists)
+                dists[i] = near->dist;
+        }
+    }
+    g_static_rec_mutex_unlock(&om->mutex);
+    return n;
+}
+
+/**
+ * Handles the LCM message that publishes the position of the forklift.
+ */
+void _om_on_pose(const lcm_recv_buf_t *rbuf, const char *channel,
+                 const bot_core_pose_t *msg, void *user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    g_static_rec_mutex_lock(&om->mutex);
+    if (om->pose) bot_core_pose_t_destroy(om->pose);
+    om->pose = bot_core_pose_t_copy(msg);
+    _om_nearby_update_pose(om);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+
+
+void om_get_stats(ObjectWorldModel *om, om_stats_t *stats)
+{
+    static const double decode_p[] = { 0.5, 0.9, 0.99, 1.0 };
+    static const double lock_p[] = { 0.5, 0.99, 1.0 };
+    int32_t decode[4], lock[3];
+    int64_t now = bot_timestamp_now();
+
+    memset(stats, 0, sizeof(om_stats_t));
+    g_static_rec_mutex_lock(&om->mutex);
+    _om_lazy_decode(om);
+    if (om->shm_name)
+    {
+        if (_om_shm_check(om))
+            stats->list_utime = om_shm_buffer(om->shm, om->shm->active & 1)->utime;
+    }
+    else
+    {
+        stats->list_utime = om->ol->utime;
+        stats->num_objects = om->ol->num_objects;
+    }
+    if (stats->list_utime)
+        stats->age = now - stats->list_utime;
+    stats->latency = om->stats_latency;
+
+    if (om->stats_interval_avg > 0)
+    {
+        stats->receive_hz = 1e6 / om->stats_interval_avg;
+        stats->receive_bytes_per_sec = stats->receive_hz * om->stats_bytes_avg;
+    }
+    stats->messages_received = om->stats_messages_received;
+    stats->bytes_received = om->stats_bytes_received;
+
+    _om_stats_percentiles(&om->stats_decode, 4, decode_p, decode);
+    stats->decode_p50 = decode[0];
+    stats->decode_p90 = decode[1];
+    stats->decode_p99 = decode[2];
+    stats->decode_max = decode[3];
+
+    _om_stats_percentiles(&om->stats_lock_wait, 3, lock_p, lock);
+    stats->lock_waits = om->stats_lock_waits;
+    stats->lock_wait_p50 = lock[0];
+    stats->lock_wait_p99 = lock[1];
+    stats->lock_wait_max = lock[2];
+
+    stats->publish_dropped = om->publish_dropped;
+    if (om->publish_queue)
+        stats->publish_dropped += om_publish_queue_get_dropped(om->publish_queue);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+static void _om_publish_stats(ObjectWorldModel *om)
+{
+    om_stats_t stats;
+    om_get_stats(om, &stats);
+
+    g_static_rec_mutex_lock(&om->mutex);
+    om_client_stats_t msg =
+    {
+        .utime = bot_timestamp_now(),
+        .client_id = om->stats_client_id,
+        .name = om->stats_name,
+        .list_utime = stats.list_utime,
+        .age = stats.age,
+        .latency = stats.latency,
+        .num_objects = stats.num_objects,
+        .receive_hz = stats.receive_hz,
+        .receive_bytes_per_sec = stats.receive_bytes_per_sec,
+        .messages_received = stats.messages_received,
+        .bytes_received = stats.bytes_received,
+        .decode_p50 = stats.decode_p50,
+        .decode_p90 = stats.decode_p90,
+        .decode_p99 = stats.decode_p99,
+        .decode_max = stats.decode_max,
+        .lock_waits = stats.lock_waits,
+        .lock_wait_p50 = stats.lock_wait_p50,
+        .lock_wait_p99 = stats.lock_wait_p99,
+        .lock_wait_max = stats.lock_wait_max,
+        .publish_dropped = stats.publish_dropped
+    };
+    om->stats_next_export = msg.utime + om->stats_export_ms * 1000;
+    om_client_stats_t_publish(om->lcm, OM_STATS_CHANNEL, &msg);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+static gboolean _om_stats_timeout(gpointer user)
+{
+    _om_publish_stats((ObjectWorldModel*)user);
+    return TRUE;
+}
+
+void om_set_stats_export(ObjectWorldModel *om, const char *name, int period_ms)
+{
+    g_static_rec_mutex_lock(&om->mutex);
+    if (om->stats_export_timer)
+    {
+        g_source_remove(om->stats_export_timer);
+        om->stats_export_timer = 0;
+    }
+    free(om->stats_name);
+    om->stats_name = strdup(name ? name : "");
+    om->stats_export_ms = MAX(period_ms, 0);
+    if (!om->stats_client_id)
+        om->stats_client_id = ((int64_t)g_random_int() << 31) ^ g_random_int();
+    om->stats_next_export = bot_timestamp_now() + om->stats_export_ms * 1000;
+    // the LCM thread of threaded objects publishes, others need the main loop
+    if (om->stats_export_ms && !om->lcm_thread)
+        om->stats_export_timer = g_timeout_add(om->stats_export_ms,
+                                               _om_stats_timeout, om);
+    g_static_rec_mutex_unlock(&om->mutex);
+}
+
+/**
+ * Body of the LCM thread of om_new_threaded() objects.
+ */
+static gpointer _om_lcm_thread(gpointer user)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)user;
+    while (!g_atomic_int_get(&om->lcm_thread_quit))
+    {
+        // wake up now and then to notice om_destroy(), and in time for the
+        // batch deadline; a batch opened while we wait is noticed within a
+        // quarter of its delay
+        g_static_rec_mutex_lock(&om->mutex);
+        int timeout_ms = OM_LCM_THREAD_POLL_MS;
+        if (om->batch_max_delay_ms > 0)
+            timeout_ms = MIN(timeout_ms, MAX(om->batch_max_delay_ms / 4, 1));
+        if (om->batch_deadline)
+            timeout_ms = MIN(timeout_ms, MAX((om->batch_deadline -
+                                              bot_timestamp_now()) / 1000, 0));
+        g_static_rec_mutex_unlock(&om->mutex);
+        lcm_handle_timeout(om->lcm, timeout_ms);
+
+        om_batch_out_t out = { 0 };
+        g_static_rec_mutex_lock(&om->mutex);
+        int64_t now = bot_timestamp_now();
+        gboolean export = om->stats_export_ms && now >= om->stats_next_export;
+        if (om->batch_deadline && now >= om->batch_deadline)
+            _om_batch_take(om, &out);
+        g_static_rec_mutex_unlock(&om->mutex);
+        _om_batch_send(om, &out);
+        if (export)
+            _om_publish_stats(om);
+    }
+    return NULL;
+}
+
+static ObjectWorldModel *_om_create(const char *shm_name, gboolean threaded)
+{
+    ObjectWorldModel *om = (ObjectWorldModel*)calloc(1, sizeof(ObjectWorldModel));
+
+    if (threaded)
+    {
+        if (!g_thread_supported())
+            g_thread_init(NULL);
+        om->own_lcm = TRUE;
+        om->lcm = lcm_create(NULL);
+    }
+    else
+        om->lcm = bot_lcm_get_global(NULL);
+    if (!om->lcm){
+        //add lcm to mainloop 
+        free(om);
+
+        ERR("Could not get LCM!\n");
+        return NULL;
+    }
+    if (!threaded)
+        bot_glib_mainloop_attach_lcm (om->lcm);
+    om->wait_mutex = g_mutex_new();
+    om->update_cond = g_cond_new();
+    om->batch_send_mutex = g_mutex_new();
+    om->batch_send_cond = g_cond_new();
+
+    // Set up param
+    if (!(om->param = bot_param_new_from_server(om->lcm, 1)))
+    {
+        if (om->own_lcm) lcm_destroy(om->lcm);
+        g_mutex_free(om->wait_mutex);
+        g_cond_free(om->update_cond);
+        g_mutex_free(om->batch_send_mutex);
+        g_cond_free(om->batch_send_cond);
+        free(om);
+
+        ERR("Could not get BotConf!\n");
+        return NULL;
+    }
+
+    // Cameras are looked up in param when first asked for, see
+    // om_get_objects_in_view().
+    om->hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                     free, _om_camera_free);
+
+    // Blocking to resolve concurrent modifications.
+    g_static_rec_mutex_init(&om->mutex);
+
+    // readers of the shared memory world model never decode object lists
+    if (shm_name)
+    {
+        om->shm_name = strdup(shm_name);
+        if (!_om_shm_check(om))
+            wrn("Shared memory world model %s not available yet\n", shm_name);
+    }
+    else
+    {
+        om->ol_sub = lcm_subscribe(om->lcm,
+              OM_OL_CHANNEL, &_om_on_object_list, om);
+        // sync answers are filtered before decoding, see _om_is_our_sync()
+        om->sync_sub = lcm_subscribe(om->lcm,
+              OM_SYNC_CHANNEL, &_om_on_sync, om);
+        om->sync_chunk_sub = lcm_subscribe(om->lcm,
+              OM_SYNC_CHUNK_CHANNEL, &_om_on_sync_chunk, om);
+        om->assembler = om_list_assembler_new();
+        om->sync_assembler = om_list_assembler_new();
+        om->chunk_sub = om_object_list_chunk_t_subscribe(om->lcm,
+              OM_OL_CHUNK_CHANNEL, &_om_on_object_list_chunk, om);
+    }
+    om->id_block_sub = om_id_block_t_subscribe(om->lcm,
+              OM_ID_BLOCK_CHANNEL, &_om_on_id_block, om);
+    
+    om->pose_sub = bot_core_pose_t_subscribe(om->lcm,
+               OM_POS_CHANNEL, &_om_on_pose, om);
+    
+    if ((!shm_name && (!om->ol_sub || !om->sync_sub || !om->sync_chunk_sub ||
+                       !om->chunk_sub)) ||
+        !om->pose_sub || !om->id_block_sub)
+    {
+        om_destroy(om);
+        ERR("Could not get subscribe to LCM messages!\n");
+        return NULL;
+    }
+
+    // Add some default (empty) lists to prevent future segfaults.
+    om->kdtree = om_kdtree_new();
+    om->bvh = om_bvh_new();
+    om->attr_index = om_attr_index_new();
+    om->nearby = g_array_new(FALSE, FALSE, sizeof(om_nearby_t));
+    om->nearby_candidates = g_array_new(FALSE, FALSE,
+                                        sizeof(om_nearby_candidate_t));
+    om->batch = g_array_new(FALSE, FALSE, sizeof(om_object_t));
+    om->batch_ids = g_hash_table_new_full(g_int64_hash, g_int64_equal, free, NULL);
+    om->snapshot_pool = om_snapshot_pool_new();
+    om_object_list_t empty = { 0 };
+    _om_set_object_list(om, &empty, 0, 0);
+
+    // don't wait for the next periodic publish to learn about the world
+    if (!shm_name)
+        om_request_sync(om);
+
+    return om;
+}
+
+ObjectWorldModel *om_new()
+{
+    return _om_create(NULL, FALSE);
+}
+
+ObjectWorldModel *om_new_threaded()
+{
+    ObjectWorldModel *om = _om_create(NULL, TRUE);
+    if (!om)
+        return NULL;
+
+    GError *err = NULL;
+    om->lcm_thread = g_thread_create(_om_lcm_thread, om, TRUE, &err);
+    if (!om->lcm_thread)
+    {
+        ERR("Could not start the LCM thread: %s\n", err ? err->message : "");
+        om_destroy(om);
+        return NULL;
+    }
+    return om;
+}
+
+ObjectWorldModel *om_new_shm(const char *shm_name)
+{
+    return _om_create(shm_name ? shm_name : OM_SHM_DEFAULT_NAME, FALSE);
+}
+
+int64_t om_get_update_count(ObjectWorldModel *om)
+{
+    g_mutex_lock(om->wait_mutex);
+    int64_t count = om->update_count;
+    g_mutex_unlock(om->wait_mutex);
+    return count;
+}
+
+/**
+ * Waits until update_count is past last_count or the absolute deadline
+ * passed, NULL for none. Returns the new count, -1 on timeout.
+ */
+static int64_t _om_wait_for_update_until(ObjectWorldModel *om,
+                                         int64_t last_count, GTimeVal *deadline)
+{
+    int64_t rtn = -1;
+    g_mutex_lock(om->wait_mutex);
+    while (om->update_count <= last_count)
+    {
+        if (!deadline)
+            g_cond_wait(om->update_cond, om->wait_mutex);
+        else if (!g_cond_timed_wait(om->update_cond, om->wait_mutex, deadline))
+            break;
+    }
+    if (om->update_count > last_count)
+        rtn = om->update_count;
+    g_mutex_unlock(om->wait_mutex);
+    return rtn;
+}
+
+static GTimeVal *_om_deadline(GTimeVal *tv, int timeout_ms)
+{
+    if (timeout_ms < 0)
+        return NULL;
+    g_get_current_time(tv);
+    g_time_val_add(tv, (long)timeout_ms * 1000);
+    return tv;
+}
+
+int64_t om_wait_for_update(ObjectWorldModel *om, int64_t last_count,
+                           int timeout_ms)
+{
+    GTimeVal tv;
+    return _om_wait_for_update_until(om, last_count,
+                                     _om_deadline(&tv, timeout_ms));
+}
+
+om_object_t *om_wait_for_object(ObjectWorldModel *om, int64_t id,
+                                int timeout_ms)
+{
+    GTimeVal tv;
+    GTimeVal *deadline = _om_deadline(&tv, timeout_ms);
+    for (;;)
+    {
+        // read the count first, so an update right after the lookup still
+        // ends the wait below
+        int64_t count = om_get_update_count(om);
+        om_object_t *obj = om_get_object_by_id(om, id);
+        if (obj)
+            return obj;
+        if (_om_wait_for_update_until(om, count, deadline) < 0)
+            return NULL;
+    }
+}
+
+void om_destroy(ObjectWorldModel *om)
+{
+    if (!om) return;
+
+    if (om->lcm_thread)
+    {
+        g_atomic_int_set(&om->lcm_thread_quit, 1);
+        g_thread_join(om->lcm_thread);
+    }
+    // publish what is still queued while we have lcm
+    _om_stop_async_publish(om);
+
+    DBG("Freeing pose\n");
+    if (om->pose) bot_core_pose_t_destroy(om->pose);
+    DBG("Freeing object list\n");
+    // snapshots still acquired by someone live on until released
+    om_snapshot_slot_clear(&om->snapshots);
+    if (om->snapshot_pool) om_snapshot_pool_close(om->snapshot_pool);
+
+    // subscribes on lcm and reads param, so it goes first
+    if (om->frames) bot_frames_destroy(om->frames);
+
+    if (om->lcm)
+    {
+        DBG("Freeing pose subscription\n");
+        if (om->pose_sub) bot_core_pose_t_unsubscribe(om->lcm, om->pose_sub);
+        DBG("Freeing object list subscription\n");
+        if (om->ol_sub) lcm_unsubscribe(om->lcm, om->ol_sub);
+        if (om->sync_sub) lcm_unsubscribe(om->lcm, om->sync_sub);
+        if (om->sync_chunk_sub) lcm_unsubscribe(om->lcm, om->sync_chunk_sub);
+        if (om->chunk_sub) om_object_list_chunk_t_unsubscribe(om->lcm, om->chunk_sub);
+        if (om->id_block_sub) om_id_block_t_unsubscribe(om->lcm, om->id_block_sub);
+        DBG("Freeing lcm\n");
+        if (om->own_lcm)
+        {
+            if (om->param) bot_param_destroy(om->param);
+            lcm_destroy(om->lcm);
+        }
+    }
+    om_list_assembler_destroy(om->assembler);
+    om_list_assembler_destroy(om->sync_assembler);
+    for (GSList *iter = om->change_subs; iter; iter = iter->next)
+    {
+        om_changes_subscription_t *sub = (om_changes_subscription_t*)iter->data;
+        om_change_tracker_destroy(sub->tracker);
+        free(sub);
+    }
+    g_slist_free(om->change_subs);
+    if (om->overlay) g_hash_table_destroy(om->overlay);
+    if (om->hash) g_hash_table_destroy(om->hash);
+    if (om->stats_export_timer) g_source_remove(om->stats_export_timer);
+    free(om->stats_name);
+    free(om->lazy_data);
+    if (om->batch)
+    {
+        // whatever was still batched is lost
+        if (om->batch_timer) g_source_remove(om->batch_timer);
+        for (int i = 0; i < om->batch->len; i++)
+            free(g_array_index(om->batch, om_object_t, i).label);
+        g_array_free(om->batch, TRUE);
+        g_hash_table_destroy(om->batch_ids);
+    }
+    om_kdtree_destroy(om->kdtree);
+    om_bvh_destroy(om->bvh);
+    om_attr_index_destroy(om->attr_index);
+    if (om->nearby) g_array_free(om->nearby, TRUE);
+    if (om->nearby_candidates) g_array_free(om->nearby_candidates, TRUE);
+    if (om->shm) munmap((void*)om->shm, om->shm_size);
+    free(om->shm_name);
+    if (om->wait_mutex) g_mutex_free(om->wait_mutex);
+    if (om->update_cond) g_cond_free(om->update_cond);
+    if (om->batch_send_mutex) g_mutex_free(om->batch_send_mutex);
+    if (om->batch_send_cond) g_cond_free(om->batch_send_cond);
+
     DBG("Freeing om\n");
     free(om);
 }
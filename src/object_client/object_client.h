@@ -6,24 +6,107 @@
 #include <lcm/lcm.h>
 #include <bot_param/param_client.h>
 #include <bot_param/param_util.h>
+#include <bot_frames/bot_frames.h>
 
 #include <lcmtypes/bot_core_pose_t.h>
 #include <lcmtypes/bot2_param.h>
 
 #include <lcmtypes/om_object_list_t.h>
 #include <lcmtypes/om_object_t.h>
+#include <lcmtypes/om_object_patch_t.h>
+#include <lcmtypes/om_region_t.h>
+#include <lcmtypes/om_object_list_sync_t.h>
+#include <lcmtypes/om_sync_request_t.h>
+#include <lcmtypes/om_id_block_request_t.h>
+#include <lcmtypes/om_id_block_t.h>
+#include <lcmtypes/om_client_stats_t.h>
+
+#include "object_shm.h"
+#include "object_ids.h"
+#include "object_list_assembler.h"
+#include "object_index.h"
+#include "object_kdtree.h"
+#include "object_bvh.h"
+#include "object_attr_index.h"
+#include "object_list_buffer.h"
+#include "object_changes.h"
+#include "object_publish_queue.h"
+#include "object_snapshot.h"
 
 
 typedef struct _object_model ObjectWorldModel;
+typedef struct _om_changes_subscription om_changes_subscription_t;
+
+#define OM_STATS_SAMPLES 256
+
+// recent samples of a duration [us], for percentiles
+typedef struct _om_stats_ring
+{
+    int32_t samples[OM_STATS_SAMPLES];
+    int count;
+    int next;
+} om_stats_ring_t;
+
+/*
+ * See om_get_stats(). Times are in microseconds.
+ */
+typedef struct _om_stats
+{
+    int64_t list_utime;             // utime of the latest object list
+    int64_t age;                    // how old that list is now
+    int64_t latency;                // how old it was when it arrived
+    int num_objects;
+
+    double receive_hz;              // object list messages, recent average
+    double receive_bytes_per_sec;
+    int64_t messages_received;      // lists, chunks and sync answers
+    int64_t bytes_received;
+
+    int32_t decode_p50;             // decoding or copying a list and
+    int32_t decode_p90;             // indexing it, over the last
+    int32_t decode_p99;             // OM_STATS_SAMPLES lists
+    int32_t decode_max;
+
+    int64_t lock_waits;             // queries that had to wait for the lock
+    int32_t lock_wait_p50;          // and how long, over the last
+    int32_t lock_wait_p99;          // OM_STATS_SAMPLES of them
+    int32_t lock_wait_max;
+
+    int64_t publish_dropped;        // by om_set_async_publish() with
+                                    // OM_QUEUE_DROP_OLDEST
+} om_stats_t;
+
+typedef struct _om_view_object
+{
+    int64_t id;
+    double dist;        // [m] from the camera to the object's position
+    double bbox[4];     // u_min, v_min, u_max, v_max [px], clipped to the image
+} om_view_object_t;
+
+typedef void (*om_changes_handler_t)(ObjectWorldModel *om,
+                                     const om_change_t *changes,
+                                     int num_changes, void *user);
+
+typedef void (*om_chunk_handler_t)(ObjectWorldModel *om,
+                                   const om_object_list_chunk_t *chunk,
+                                   void *user);
 
 #define OM_POS_CHANNEL         "POSE"
 #define OM_OL_CHANNEL          "OBJECT_LIST"
+#define OM_OL_CHUNK_CHANNEL    "OBJECT_LIST_CHUNK"
+#define OM_SYNC_REQUEST_CHANNEL "OBJECT_LIST_SYNC_REQUEST"
+#define OM_SYNC_CHANNEL        "OBJECT_LIST_SYNC"
+#define OM_SYNC_CHUNK_CHANNEL  "OBJECT_LIST_SYNC_CHUNK"
+#define OM_STATS_CHANNEL       "OBJECT_CLIENT_STATS"
 
 // NOTE: dynamic objects subscribes to "(OBJECTS|PALLETS)_UPDATE.*"
 //   So we can send on multiple channels, have it function correctly, and
 //   allow humans to differentiate by message intent.
 #define OBJECT_ADD_CHANNEL     "OBJECTS_UPDATE_ADD"
 #define OBJECT_UPDATE_CHANNEL  "OBJECTS_UPDATE"
+#define OBJECT_PATCH_CHANNEL   "OBJECTS_PATCH"
+#define OM_REGION_CHANNEL       "OBJECT_REGIONS"
+#define OM_REGION_EVENT_CHANNEL "OBJECT_REGION_EVENTS"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,10 +118,105 @@ extern "C" {
      * @obj The object to add to the object model.
      * Returns: < 0 on error
      *
-     * Adds a object to the object model.
+     * Adds a object to the object model. An @obj without id (<= 0) gets a
+     * fresh one, see om_set_id_block_size().
      */
 
     int om_add_object(ObjectWorldModel *om, om_object_t *obj);
+
+    /**
+     * om_add_objects:
+     * @om The object model object.
+     * @objects The objects to add.
+     * @num_objects The number of @objects.
+     * Returns: < 0 on error
+     *
+     * Adds all @objects at once, as a single list unless a batch is open.
+     * Objects without id get fresh ones, assigned in one go.
+     */
+    int om_add_objects(ObjectWorldModel *om, om_object_t *objects,
+                       int num_objects);
+
+    /**
+     * om_set_id_block_size:
+     * @om The object model object.
+     * @block_size How many ids to reserve from the server at a time, 0 to
+     *             stop reserving.
+     *
+     * By default new objects get ids made up by this process, which can
+     * collide only if another process happened to pick the same random
+     * prefix. With blocks reserved from the server they can't collide at
+     * all. The next block is requested when half of the ids are used up;
+     * without one at hand, ids are made up locally as before. Off by
+     * default.
+     */
+    void om_set_id_block_size(ObjectWorldModel *om, int block_size);
+
+    /**
+     * om_begin_batch:
+     * @om The object model object.
+     *
+     * Starts collecting updates instead of publishing each on its own. Until
+     * om_commit_batch(), om_add_object(), om_update_object(),
+     * om_update_object_pos() and om_batch_update() only add to the batch,
+     * and a later update of an object replaces an earlier one. The batch
+     * belongs to @om, not to the calling thread.
+     */
+    void om_begin_batch(ObjectWorldModel *om);
+
+    /**
+     * om_batch_update:
+     * @om The object model object.
+     * @obj The object to update; it is copied.
+     * Returns: < 0 on error
+     *
+     * Adds an update to the open batch, or publishes it right away if no
+     * batch is open.
+     */
+    int om_batch_update(ObjectWorldModel *om, const om_object_t *obj);
+
+    /**
+     * om_commit_batch:
+     * @om The object model object.
+     * Returns: < 0 on error
+     *
+     * Publishes the batch as a single object list and closes it.
+     */
+    int om_commit_batch(ObjectWorldModel *om);
+
+    /**
+     * om_set_batch_autoflush:
+     * @om The object model object.
+     * @max_objects Publish the batch once it holds this many objects,
+     *              0 for no limit.
+     * @max_delay_ms Publish the batch at most this long after its first
+     *               update, 0 for no limit. Needs a running glib main loop
+     *               unless @om came from om_new_threaded().
+     *
+     * Publishes an open batch early without closing it.
+     */
+    void om_set_batch_autoflush(ObjectWorldModel *om, int max_objects,
+                                int max_delay_ms);
+
+    /**
+     * om_set_async_publish:
+     * @om The object model object.
+     * @capacity How many updates may wait to be published, 0 to publish
+     *           synchronously again.
+     * @policy What to do when that many are waiting: OM_QUEUE_DROP_OLDEST
+     *         drops the oldest waiting update, OM_QUEUE_BLOCK waits for the
+     *         publisher to catch up.
+     *
+     * Hands updates to a publisher thread instead of publishing them in
+     * the calling thread, so om_add_object(), om_update_object() and
+     * friends only copy the object into a queue. The publisher sends
+     * whatever is waiting as one list on OBJECT_UPDATE_CHANNEL, with only
+     * the latest update of each object. Batches (om_begin_batch()) are
+     * queued when committed. Turning it off publishes what is still
+     * waiting. Off by default.
+     */
+    void om_set_async_publish(ObjectWorldModel *om, int capacity,
+                              om_queue_policy_t policy);
     
     /**
      * om_new:
@@ -92,17 +270,65 @@ extern "C" {
      * @dz The change in the Z-coordinate.
      *
      * Request that you update the position of a specific object in the world.
+     * The server adds the offset to the position it has, so moves by
+     * several clients add up; see om_patch_object().
      */
     void om_move_object_by_by_id(ObjectWorldModel *om, int64_t id,
                                  double dx, double dy, double dz);
 
+    /**
+     * om_patch_object:
+     * @om The ObjectWorldModel object.
+     * @patch The fields to change and how, see om_object_patch_t.
+     * Returns: < 0 on error
+     *
+     * Has the server change some fields of an object, in place of a read,
+     * change and om_update_object(). The server applies patches to its own
+     * state one at a time, so relative changes by several clients are
+     * never lost, and only the patched fields go over the wire. Patches
+     * are published right away, even while a batch is open or with async
+     * publishing, and don't show in the overlay.
+     */
+    int om_patch_object(ObjectWorldModel *om, const om_object_patch_t *patch);
+
+    /**
+     * om_attach_object:
+     * @om The ObjectWorldModel object.
+     * @id The object to attach, say a pallet.
+     * @parent_id What to attach it to, say the truck it is on; 0 to detach.
+     * Returns: < 0 on error
+     *
+     * From then on the object keeps its place relative to the parent: the
+     * server moves it along whenever the parent moves, so one update of the
+     * parent moves everything on it. Object lists still show world poses.
+     * Updates of an attached object move it relative to the parent.
+     * Attached objects stay out of the obstacle grid.
+     */
+    int om_attach_object(ObjectWorldModel *om, int64_t id, int64_t parent_id);
+
+    /**
+     * om_set_region:
+     * @om The ObjectWorldModel object.
+     * @region The region to watch, or to stop watching if region->remove
+     *         is set; see om_region_t.
+     * Returns: < 0 on error
+     *
+     * Has the server watch a region and report objects entering, leaving
+     * and dwelling in it as om_region_event_t on OM_REGION_EVENT_CHANNEL,
+     * so no client has to test every object against it on every list.
+     * Registering a region_id again replaces the region. The server keeps
+     * regions in memory only; register them again when it restarts.
+     */
+    int om_set_region(ObjectWorldModel *om, const om_region_t *region);
+
     /**
      * om_get_object_by_id:
      * @om The ObjectWorldModel object.
      * @id The ID of the object to retrieve.
-     * Returns: The most-recently received list of objects.
+     * Returns: A copy of the object, free with om_object_t_destroy(), or NULL.
      *
-     * Gets the object by its ID with a sequential search.
+     * Gets a copy of the object with the given ID, found through a hash
+     * index built once per received object list.
      */
     om_object_t *om_get_object_by_id(ObjectWorldModel *om, int64_t id);
 
@@ -117,11 +343,137 @@ extern "C" {
      *
      * Returns: The ID of the object nearest to specified (x,y,z) or -1
      *
-     * Finds the id of the object nearest to specified (x,y,z) in the local frame.
+     * Finds the id of the object nearest to specified (x,y,z) in the local
+     * frame. Objects farther than 20 m away are not considered.
      */
     int64_t om_get_object_id_by_pos(ObjectWorldModel *om, double x, double y, 
                                     double z, double *dist);
 
+    /**
+     * om_get_k_nearest_objects:
+     * @om The ObjectWorldModel object.
+     * @x, @y, @z The query point in the local frame.
+     * @k The most objects to return.
+     * @max_dist Objects farther away are not considered.
+     * @ids (returned) Room for @k object IDs, closest first.
+     * @dists (returned) Room for @k distances, or NULL.
+     * Returns: The number of IDs written to @ids.
+     *
+     * The geometric queries run on a k-d tree over the current object list,
+     * built on the first query after a list arrived. They return IDs only;
+     * use om_get_object_by_id() for the objects themselves.
+     */
+    int om_get_k_nearest_objects(ObjectWorldModel *om, double x, double y,
+                                 double z, int k, double max_dist, int64_t *ids,
+                                 double *dists);
+
+    /**
+     * om_get_nearest_object_of_type:
+     * @object_type One of the OM_OBJECT_T_* types.
+     * @dist (returned) The distance to the object, DBL_MAX if there is none.
+     * Returns: The ID of the closest object of @object_type within
+     *          @max_dist of (x,y,z), or -1.
+     */
+    int64_t om_get_nearest_object_of_type(ObjectWorldModel *om, double x,
+                                          double y, double z,
+                                          int16_t object_type, double max_dist,
+                                          double *dist);
+
+    /**
+     * om_get_objects_in_radius:
+     * @ids (returned) malloc'd array of the object IDs; free() it.
+     * Returns: The number of objects within @radius of (x,y,z).
+     */
+    int om_get_objects_in_radius(ObjectWorldModel *om, double x, double y,
+                                 double z, double radius, int64_t **ids);
+
+    /**
+     * om_get_objects_in_box:
+     * @min, @max Opposite corners of an axis-aligned box in the local frame.
+     * @ids (returned) malloc'd array of the object IDs; free() it.
+     * Returns: The number of objects whose position lies in the box.
+     */
+    int om_get_objects_in_box(ObjectWorldModel *om, const double min[3],
+                              const double max[3], int64_t **ids);
+
+    /**
+     * om_get_objects_by_type:
+     * @ids (returned) malloc'd array of the object IDs, ascending; free() it.
+     * Returns: The number of objects of @object_type.
+     *
+     * The type and label queries use an index that is brought up to date
+     * on the first of them after a list arrived, at a cost that grows with
+     * the number of objects added, removed or retyped or relabelled. The
+     * queries themselves take time in proportion to what they return.
+     */
+    int om_get_objects_by_type(ObjectWorldModel *om, int16_t object_type,
+                               int64_t **ids);
+
+    /**
+     * om_get_object_by_label:
+     * Returns: A copy of the object labelled @label, as om_get_object_by_id()
+     *          would return it, or NULL. If several share the label, the
+     *          one with the lowest ID.
+     */
+    om_object_t *om_get_object_by_label(ObjectWorldModel *om, const char *label);
+
+    /**
+     * om_get_objects_by_label_prefix:
+     * @ids (returned) malloc'd array of the object IDs, ordered by label;
+     *      free() it.
+     * Returns: The number of objects whose label starts with @prefix.
+     */
+    int om_get_objects_by_label_prefix(ObjectWorldModel *om, const char *prefix,
+                                       int64_t **ids);
+
+    /**
+     * om_raycast:
+     * @origin, @dir The ray in the local frame; @dir need not be normalized.
+     * @max_dist Ignore objects farther than this along the ray.
+     * @dist (returned) Distance from @origin to where the ray hits.
+     * Returns: The ID of the first object whose oriented bounding box the
+     *          ray enters, or -1. Objects without a bounding box count as
+     *          a small cube around their position; boxes containing
+     *          @origin are ignored.
+     */
+    int64_t om_raycast(ObjectWorldModel *om, const double origin[3],
+                       const double dir[3], double max_dist, double *dist);
+
+    /**
+     * om_get_objects_in_view:
+     * @camera_name A camera calibrated in param (cameras.<name>).
+     * @max_range Only consider objects within this distance of the camera.
+     * @objects (returned) malloc'd array of the visible objects, nearest
+     *          first; free() it.
+     * Returns: The number of objects whose bounding box shows in the image
+     *          of the camera, -1 if the camera or its pose is unknown.
+     *
+     * Each visible object comes with the image region its bounding box
+     * projects to. Occlusion is not taken into account.
+     */
+    int om_get_objects_in_view(ObjectWorldModel *om, const char *camera_name,
+                               double max_range, om_view_object_t **objects);
+
+    /**
+     * om_set_nearby_radius:
+     * @radius Keep track of the objects this close to the robot, 0 to stop.
+     *
+     * The objects around the robot (POSE) are kept up to date on every pose
+     * and object list, so om_get_nearby_objects() just copies them out.
+     */
+    void om_set_nearby_radius(ObjectWorldModel *om, double radius);
+
+    /**
+     * om_get_nearby_objects:
+     * @max_objects The size of @ids and @dists.
+     * @ids (returned) The IDs of the objects nearest to the robot first.
+     * @dists (returned) Their distances to the robot, may be NULL.
+     * Returns: The number of objects within the radius set by
+     *          om_set_nearby_radius(), at most @max_objects.
+     */
+    int om_get_nearby_objects(ObjectWorldModel *om, int max_objects,
+                              int64_t *ids, double *dists);
+
 
     /**
      * om_get_truck_id_by_pos:
@@ -138,6 +490,219 @@ extern "C" {
 
     ObjectWorldModel *om_new();
 
+    /**
+     * om_new_threaded:
+     * Returns: The newly-allocated ObjectWorldModel object.
+     *
+     * Like om_new(), but the object handles its own LCM instance in a
+     * thread of its own, so no glib main loop needs to run. That thread
+     * also flushes batches by time (om_set_batch_autoflush()) and exports
+     * statistics (om_set_stats_export()).
+     */
+    ObjectWorldModel *om_new_threaded();
+
+    /**
+     * om_get_update_count:
+     * @om The ObjectWorldModel object.
+     * Returns: How many object lists @om has taken in so far.
+     */
+    int64_t om_get_update_count(ObjectWorldModel *om);
+
+    /**
+     * om_wait_for_update:
+     * @om The ObjectWorldModel object.
+     * @last_count An update count seen before, e.g. from
+     *             om_get_update_count().
+     * @timeout_ms How long to wait at most, < 0 for no limit.
+     * Returns: The new update count, or -1 on timeout.
+     *
+     * Blocks until an object list newer than @last_count was taken in.
+     * Someone has to handle LCM meanwhile: the thread of an
+     * om_new_threaded() object, or a main loop in another thread. Not
+     * available for om_new_shm() objects.
+     */
+    int64_t om_wait_for_update(ObjectWorldModel *om, int64_t last_count,
+                               int timeout_ms);
+
+    /**
+     * om_wait_for_object:
+     * @om The ObjectWorldModel object.
+     * @id The ID of the object to wait for.
+     * @timeout_ms How long to wait at most, < 0 for no limit.
+     * Returns: A copy of the object, as from om_get_object_by_id(), or NULL
+     *          on timeout.
+     *
+     * Blocks until the object with @id exists. The same rules as for
+     * om_wait_for_update() apply.
+     */
+    om_object_t *om_wait_for_object(ObjectWorldModel *om, int64_t id,
+                                    int timeout_ms);
+
+    /**
+     * om_new_shm:
+     * @shm_name The shared memory segment the server publishes into
+     *           (object-server --shm), or NULL for OM_SHM_DEFAULT_NAME.
+     * Returns: The newly-allocated ObjectWorldModel object.
+     *
+     * Creates a new ObjectWorldModel object that reads the world model
+     * from shared memory instead of decoding OBJECT_LIST messages. Lookups
+     * run directly on the shared records; only the object returned is
+     * copied. The server must run on the same host.
+     */
+    ObjectWorldModel *om_new_shm(const char *shm_name);
+
+    /**
+     * om_request_sync:
+     * @om The ObjectWorldModel object.
+     * Returns: < 0 on error
+     *
+     * Asks the server for the complete world model. The server answers on
+     * OM_SYNC_CHANNEL right away instead of waiting for its next periodic
+     * publish, in chunks on OM_SYNC_CHUNK_CHANNEL if the world is large, or
+     * just confirms when we are already current. om_new() sends one of these
+     * itself, so this is only needed after a long outage.
+     */
+    int om_request_sync(ObjectWorldModel *om);
+
+    /**
+     * om_acquire_snapshot:
+     * @om The ObjectWorldModel object.
+     * Returns: The current world, or NULL for an om_new_shm() object.
+     *
+     * Takes a reference on the current world without locking; the world
+     * it refers to never changes, however many lists arrive meanwhile.
+     * Objects read through it are not copied and stay valid until the
+     * snapshot is released with om_release_snapshot(). Any thread may
+     * acquire and release snapshots.
+     */
+    const om_snapshot_t *om_acquire_snapshot(ObjectWorldModel *om);
+
+    /**
+     * om_release_snapshot:
+     * @snap A snapshot from om_acquire_snapshot(), or NULL.
+     *
+     * Drops the reference. This may outlive the ObjectWorldModel.
+     */
+    void om_release_snapshot(const om_snapshot_t *snap);
+
+    /**
+     * om_snapshot_get_objects:
+     * @snap The snapshot.
+     * @num_objects (returned) Number of objects in the array.
+     * Returns: All objects of the snapshot.
+     */
+    const om_object_t *om_snapshot_get_objects(const om_snapshot_t *snap,
+                                               int *num_objects);
+
+    /**
+     * om_snapshot_get_object_by_id:
+     * @snap The snapshot.
+     * @id The ID of the object.
+     * Returns: The object, owned by @snap, or NULL.
+     */
+    const om_object_t *om_snapshot_get_object_by_id(const om_snapshot_t *snap,
+                                                    int64_t id);
+
+    /**
+     * om_snapshot_get_utime:
+     * Returns: The utime of the object list the snapshot holds.
+     */
+    int64_t om_snapshot_get_utime(const om_snapshot_t *snap);
+
+    /**
+     * om_snapshot_get_version:
+     * Returns: The server version of the snapshot, 0 if unknown.
+     */
+    int64_t om_snapshot_get_version(const om_snapshot_t *snap);
+
+    /**
+     * om_set_chunk_handler:
+     * @om The ObjectWorldModel object.
+     * @handler Called with every chunk of a large object list as it
+     *          arrives, or NULL to stop.
+     * @user Passed to @handler.
+     *
+     * Large worlds are published in chunks, and the object list returned by
+     * the om_get_* functions is only replaced once all chunks of it arrived.
+     * Consumers that can use a partial world, e.g. to start drawing, may
+     * look at the chunks themselves. @handler runs in the LCM thread.
+     */
+    void om_set_chunk_handler(ObjectWorldModel *om, om_chunk_handler_t handler,
+                              void *user);
+
+    /**
+     * om_subscribe_changes:
+     * @om The ObjectWorldModel object.
+     * @min_translation Only report a move once the object got this far [m]
+     *                  from where it was last reported ...
+     * @min_rotation ... or turned by this angle [rad]. With both 0 every
+     *               change of pose is reported.
+     * @handler Called with all changes of an object list at once, if there
+     *          are any. It runs in the LCM thread with @om locked; the
+     *          changes point into object lists and are only valid during
+     *          the call.
+     * @user Passed to @handler.
+     * Returns: The subscription, for om_unsubscribe_changes().
+     *
+     * Reports objects added, moved, modified and removed from one object
+     * list to the next. Objects already known when subscribing are not
+     * reported as added. Not available for om_new_shm() objects.
+     */
+    om_changes_subscription_t *om_subscribe_changes(ObjectWorldModel *om,
+                                                    double min_translation,
+                                                    double min_rotation,
+                                                    om_changes_handler_t handler,
+                                                    void *user);
+
+    void om_unsubscribe_changes(ObjectWorldModel *om,
+                                om_changes_subscription_t *sub);
+
+    /**
+     * om_set_overlay:
+     * @om The ObjectWorldModel object.
+     * @enable Whether to show our own updates right away.
+     *
+     * With the overlay on, om_get_object_by_id() returns an object as this
+     * client last sent it until an object list from the server shows it
+     * with an equal or newer utime, instead of the server's older state.
+     * Other queries still show the server's world. Off by default.
+     */
+    void om_set_overlay(ObjectWorldModel *om, gboolean enable);
+
+    /**
+     * om_set_lazy_decode:
+     * @om The ObjectWorldModel object.
+     * @enable Whether to decode object lists only when queried.
+     *
+     * In lazy mode only the last object list message is kept as it is, and
+     * decoded by the first query after it came in. Meant for clients that
+     * query now and then; the world is as fresh as without it, but idle
+     * clients don't pay for every list. While change subscriptions exist,
+     * lists are decoded right away regardless. Off by default.
+     */
+    void om_set_lazy_decode(ObjectWorldModel *om, gboolean enable);
+
+    /**
+     * om_get_stats:
+     * @om The ObjectWorldModel object.
+     * @stats (returned) How fresh the world model is and how it is doing.
+     *
+     * Cheap enough to call now and then; the percentiles sort a few
+     * hundred samples. In shm mode only the list utime and age are known.
+     */
+    void om_get_stats(ObjectWorldModel *om, om_stats_t *stats);
+
+    /**
+     * om_set_stats_export:
+     * @om The ObjectWorldModel object.
+     * @name Tells this process apart on dashboards.
+     * @period_ms Publish an om_client_stats_t on OM_STATS_CHANNEL this
+     *            often, 0 to stop. Needs a running glib main loop unless
+     *            @om came from om_new_threaded().
+     */
+    void om_set_stats_export(ObjectWorldModel *om, const char *name,
+                             int period_ms);
+
     /**
      * om_destroy:
      * @om The ObjectWorldModel object to destroy.
@@ -153,13 +718,103 @@ extern "C" {
         GStaticRecMutex mutex;
         
         lcm_t *lcm;
+        gboolean own_lcm;                         // created by om_new_threaded().
+        GThread *lcm_thread;
+        volatile gint lcm_thread_quit;
+
+        GMutex *wait_mutex;                       // guards update_count.
+        GCond *update_cond;                       // signalled on every new list.
+        int64_t update_count;
         om_object_list_t *ol;                     // last seen object list.
-        om_object_list_t_subscription_t *ol_sub;  // object list subscription.
+        om_snapshot_slot_t snapshots;             // holds ol, see om_acquire_snapshot().
+        om_snapshot_pool_t *snapshot_pool;        // released snapshots, for reuse.
+        om_kdtree_t *kdtree;                      // positions, built lazily.
+        gboolean kdtree_dirty;                    // kdtree older than ol.
+        int64_t kdtree_shm_utime;                 // shm world in kdtree.
+        om_bvh_t *bvh;                            // bounding boxes, built lazily.
+        gboolean bvh_dirty;                       // bvh older than ol.
+        int64_t bvh_shm_utime;                    // shm world in bvh.
+        om_attr_index_t *attr_index;              // types and labels, synced lazily.
+        gboolean attr_dirty;                      // attr_index older than ol.
+        int64_t attr_shm_utime;                   // shm world in attr_index.
+        lcm_subscription_t *ol_sub;               // object list subscription.
+        om_id_block_t_subscription_t *id_block_sub; // id block answers.
+        volatile gint id_block_size;              // see om_set_id_block_size().
+        int64_t id_next, id_end;                  // server ids we have left.
+        int64_t id_spare_next, id_spare_end;      // the block after that.
+        int64_t id_block_request_id;              // our request under way.
+        int64_t id_block_request_utime;
+        lcm_subscription_t *sync_sub;             // sync response subscription.
+        lcm_subscription_t *sync_chunk_sub;       // chunked sync responses.
+        om_object_list_chunk_t_subscription_t *chunk_sub; // object list chunks.
+        om_list_assembler_t *assembler;           // reassembles chunked lists.
+        om_list_assembler_t *sync_assembler;      // reassembles chunked responses.
+        om_chunk_handler_t chunk_handler;
+        void *chunk_handler_user;
+        int64_t sync_request_id;                  // id of our last sync request.
+        int64_t version;                          // server version of ol, if known.
+        int64_t epoch;                            // server epoch of that version.
         bot_core_pose_t *pose;                         // position of the bot.
         bot_core_pose_t_subscription_t *pose_sub;      // position subscription.
+        double nearby_radius;                     // see om_set_nearby_radius().
+        double nearby_center[3];                  // pose at the last scan.
+        GArray *nearby_candidates;                // within radius + slack of it.
+        gboolean nearby_scanned;                  // candidates are from ol and radius.
+        GArray *nearby;                           // within radius, sorted.
         BotParam   *param;
+        BotFrames  *frames;                       // for camera poses, owned.
         
-        GHashTable *hash;
+        GHashTable *hash;                         // camera name -> calibration.
+
+        GHashTable *overlay;                      // id -> our unconfirmed update.
+        gboolean lazy;                            // see om_set_lazy_decode().
+        volatile gint lazy_pending;               // lazy_data newer than ol.
+        void *lazy_data;                          // last encoded object list.
+        int lazy_size;
+        int lazy_capacity;
+
+        int64_t stats_last_receive;               // see om_get_stats().
+        double stats_interval_avg;                // between messages [us].
+        double stats_bytes_avg;
+        int64_t stats_messages_received;
+        int64_t stats_bytes_received;
+        int64_t stats_latency;
+        om_stats_ring_t stats_decode;
+        om_stats_ring_t stats_lock_wait;
+        int64_t stats_lock_waits;
+        char *stats_name;                         // see om_set_stats_export().
+        int64_t stats_client_id;
+        int stats_export_ms;
+        int64_t stats_next_export;
+        guint stats_export_timer;
+        GSList *change_subs;                      // om_changes_subscription_t.
+
+        // batched updates, see om_begin_batch()
+        gboolean batching;
+        GArray *batch;                            // om_object_t, labels owned.
+        GHashTable *batch_ids;                    // id -> position in batch.
+        int batch_max_objects;
+        int batch_max_delay_ms;
+        guint batch_timer;
+        int64_t batch_deadline;                   // when the open batch is due, 0 if none.
+        GMutex *batch_send_mutex;                 // guards batch_sent.
+        GCond *batch_send_cond;                   // signalled when a batch went out.
+        guint batch_taken;                        // batches taken out to send.
+        guint batch_sent;                         // of those, the ones sent.
+
+        // async publishing, see om_set_async_publish()
+        om_publish_queue_t *publish_queue;
+        GThread *publish_thread;
+        volatile gint publish_thread_quit;
+        volatile gint publish_pushers;            // pushing without the mutex.
+        int64_t publish_dropped;                  // by queues already gone.
+
+        // shared memory world model, see om_new_shm()
+        char *shm_name;
+        const om_shm_header_t *shm;
+        size_t shm_size;
+        unsigned long shm_ino;
+        int64_t shm_check_utime;
     };
 
 #ifdef __cplusplus
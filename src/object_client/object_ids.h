@@ -0,0 +1,33 @@
+#ifndef __OBJECT_IDS_H
+#define __OBJECT_IDS_H
+
+#include <stdint.h>
+
+/*
+ * How object ids are laid out, so that clients can name new objects
+ * without asking anyone and still never collide.
+ *
+ * Ids below OM_ID_BLOCK_BASE are fixed ids (the forklift, frames, ...).
+ *
+ * Ids in [OM_ID_BLOCK_BASE, OM_ID_BLOCK_END) are handed out by the object
+ * server in blocks (om_id_block_request_t), so they are unique for sure.
+ *
+ * Ids with OM_ID_LOCAL_BIT set are made up by a client process: a random
+ * prefix picked once per process, followed by a counter. Only two
+ * processes that pick the same prefix can collide.
+ *
+ * Ids from older clients, made of a timestamp, lie in between.
+ */
+
+#define OM_ID_BLOCK_REQUEST_CHANNEL "OBJECT_ID_BLOCK_REQUEST"
+#define OM_ID_BLOCK_CHANNEL         "OBJECT_ID_BLOCK"
+
+#define OM_ID_BLOCK_BASE    ((int64_t)1 << 40)
+#define OM_ID_BLOCK_END     ((int64_t)1 << 56)
+#define OM_ID_BLOCK_MAX     (1 << 20)   // most ids per block
+
+#define OM_ID_LOCAL_BIT     ((int64_t)1 << 62)
+#define OM_ID_COUNTER_BITS  32
+#define OM_ID_PREFIX_BITS   30
+
+#endif
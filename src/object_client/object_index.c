@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "object_index.h"
+
+// tables are kept at most half full so probe sequences stay short
+#define MIN_CAPACITY 16
+
+typedef struct _om_object_index_slot
+{
+    int64_t id;
+    int32_t pos;    // position in the object list plus one, 0 if empty
+} om_object_index_slot_t;
+
+struct _om_object_index
+{
+    om_object_index_slot_t *slots;
+    uint32_t capacity;  // always a power of two
+};
+
+// ids are often timestamps shifted left, so mix all bits into the low ones
+static inline uint32_t _om_hash_id(int64_t id)
+{
+    uint64_t h = (uint64_t)id;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (uint32_t)h;
+}
+
+om_object_index_t *om_object_index_new(void)
+{
+    return (om_object_index_t*)calloc(1, sizeof(om_object_index_t));
+}
+
+void om_object_index_destroy(om_object_index_t *index)
+{
+    if (!index) return;
+    free(index->slots);
+    free(index);
+}
+
+void om_object_index_build(om_object_index_t *index, const om_object_t *objects,
+                           int num_objects)
+{
+    uint32_t capacity = MIN_CAPACITY;
+    while (capacity < 2 * (uint32_t)num_objects)
+        capacity <<= 1;
+
+    // also shrink once the world got much smaller, clearing costs capacity
+    if (capacity > index->capacity || 4 * capacity < index->capacity)
+    {
+        free(index->slots);
+        index->slots = (om_object_index_slot_t*)malloc(
+            capacity * sizeof(om_object_index_slot_t));
+        index->capacity = capacity;
+    }
+    memset(index->slots, 0, index->capacity * sizeof(om_object_index_slot_t));
+
+    uint32_t mask = index->capacity - 1;
+    for (int i = 0; i < num_objects; i++)
+    {
+        int64_t id = objects[i].id;
+        uint32_t s = _om_hash_id(id) & mask;
+        while (index->slots[s].pos && index->slots[s].id != id)
+            s = (s + 1) & mask;
+        if (!index->slots[s].pos)
+        {
+            index->slots[s].id = id;
+            index->slots[s].pos = i + 1;
+        }
+    }
+}
+
+int om_object_index_lookup(const om_object_index_t *index, int64_t id)
+{
+    if (!index->capacity)
+        return -1;
+
+    uint32_t mask = index->capacity - 1;
+    for (uint32_t s = _om_hash_id(id) & mask; index->slots[s].pos; s = (s + 1) & mask)
+    {
+        if (index->slots[s].id == id)
+            return index->slots[s].pos - 1;
+    }
+    return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef __OBJECT_INDEX_H
+#define __OBJECT_INDEX_H
+
+#include <lcmtypes/om_object_t.h>
+
+/*
+ * Open addressing hash from object id to the object's position in an
+ * object list, rebuilt by the client whenever a new list arrives.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_object_index om_object_index_t;
+
+om_object_index_t *om_object_index_new(void);
+
+void om_object_index_destroy(om_object_index_t *index);
+
+/**
+ * om_object_index_build:
+ * @index The index.
+ * @objects The objects to index, which the index does not keep.
+ * @num_objects Number of @objects.
+ *
+ * Replaces the contents of @index, reusing its table where it is big
+ * enough. If ids repeat, the first object with the id wins.
+ */
+void om_object_index_build(om_object_index_t *index, const om_object_t *objects,
+                           int num_objects);
+
+/**
+ * om_object_index_lookup:
+ * Returns: The position of the object with @id in the indexed objects, or
+ *          -1 if there is none.
+ */
+int om_object_index_lookup(const om_object_index_t *index, int64_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
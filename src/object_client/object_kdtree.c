@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+#include "object_kdtree.h"
+
+/*
+ * The tree is implicit: the node of a range of points is its middle point,
+ * the range is split on axis depth % 3, and the points before and after the
+ * middle form the two subtrees.
+ */
+
+struct _om_kdtree
+{
+    om_kdtree_point_t *points;
+    int num_points;
+};
+
+// growable id array for the range queries
+typedef struct _id_array
+{
+    int64_t *ids;
+    int len;
+    int capacity;
+} id_array_t;
+
+static void id_array_append(id_array_t *a, int64_t id)
+{
+    if (a->len == a->capacity)
+    {
+        a->capacity = a->capacity ? 2 * a->capacity : 16;
+        a->ids = (int64_t*)realloc(a->ids, a->capacity * sizeof(int64_t));
+    }
+    a->ids[a->len++] = id;
+}
+
+static inline double dist_sq(const double a[3], const double b[3])
+{
+    return (a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) +
+        (a[2]-b[2])*(a[2]-b[2]);
+}
+
+om_kdtree_t *om_kdtree_new(void)
+{
+    return (om_kdtree_t*)calloc(1, sizeof(om_kdtree_t));
+}
+
+void om_kdtree_destroy(om_kdtree_t *tree)
+{
+    if (!tree) return;
+    free(tree->points);
+    free(tree);
+}
+
+static inline void swap_points(om_kdtree_point_t *a, om_kdtree_point_t *b)
+{
+    om_kdtree_point_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// moves the point that belongs at k (by axis) there, no larger ones before
+// it and no smaller ones after. Partitions three ways, objects often share
+// a coordinate (all on the floor, say).
+static void select_kth(om_kdtree_point_t *p, int lo, int hi, int k, int axis)
+{
+    while (hi - lo > 1)
+    {
+        double pivot = p[lo + (hi - lo) / 2].pos[axis];
+        int lt = lo, i = lo, gt = hi;
+        while (i < gt)
+        {
+            if (p[i].pos[axis] < pivot)
+                swap_points(&p[i++], &p[lt++]);
+            else if (p[i].pos[axis] > pivot)
+                swap_points(&p[i], &p[--gt]);
+            else
+                i++;
+        }
+
+        if (k < lt)
+            hi = lt;
+        else if (k >= gt)
+            lo = gt;
+        else
+            return;
+    }
+}
+
+static void build(om_kdtree_point_t *p, int lo, int hi, int depth)
+{
+    if (hi - lo <= 1)
+        return;
+    int mid = lo + (hi - lo) / 2;
+    select_kth(p, lo, hi, mid, depth % 3);
+    build(p, lo, mid, depth + 1);
+    build(p, mid + 1, hi, depth + 1);
+}
+
+void om_kdtree_build(om_kdtree_t *tree, om_kdtree_point_t *points,
+                     int num_points)
+{
+    free(tree->points);
+    tree->points = points;
+    tree->num_points = num_points;
+    build(points, 0, num_points, 0);
+}
+
+/* k nearest, kept as a max-heap on the distance so the worst is on top */
+
+typedef struct _knn
+{
+    int k;
+    int len;
+    double *d_sq;
+    int64_t *ids;
+    double max_d_sq;
+    int object_type;
+} knn_t;
+
+static inline double knn_bound(const knn_t *q)
+{
+    return q->len < q->k ? q->max_d_sq : q->d_sq[0];
+}
+
+// puts (d_sq, id) on top of the heap, in place of the current top
+static void knn_replace_top(knn_t *q, double d_sq, int64_t id)
+{
+    int i = 0;
+    for (;;)
+    {
+        int c = 2 * i + 1;
+        if (c >= q->len)
+            break;
+        if (c + 1 < q->len && q->d_sq[c + 1] > q->d_sq[c])
+            c++;
+        if (q->d_sq[c] <= d_sq)
+            break;
+        q->d_sq[i] = q->d_sq[c];
+        q->ids[i] = q->ids[c];
+        i = c;
+    }
+    q->d_sq[i] = d_sq;
+    q->ids[i] = id;
+}
+
+static void knn_push(knn_t *q, double d_sq, int64_t id)
+{
+    if (q->len == q->k)
+    {
+        knn_replace_top(q, d_sq, id);
+        return;
+    }
+
+    int i = q->len++;
+    while (i > 0 && q->d_sq[(i - 1) / 2] < d_sq)
+    {
+        q->d_sq[i] = q->d_sq[(i - 1) / 2];
+        q->ids[i] = q->ids[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->d_sq[i] = d_sq;
+    q->ids[i] = id;
+}
+
+static void knn_search(const om_kdtree_point_t *p, int lo, int hi, int depth,
+                       const double pt[3], knn_t *q)
+{
+    if (lo >= hi)
+        return;
+    int mid = lo + (hi - lo) / 2;
+    int axis = depth % 3;
+
+    double d_sq = dist_sq(pt, p[mid].pos);
+    if (d_sq <= knn_bound(q) &&
+        (q->object_type < 0 || p[mid].object_type == q->object_type))
+        knn_push(q, d_sq, p[mid].id);
+
+    double diff = pt[axis] - p[mid].pos[axis];
+    if (diff < 0)
+    {
+        knn_search(p, lo, mid, depth + 1, pt, q);
+        if (diff * diff <= knn_bound(q))
+            knn_search(p, mid + 1, hi, depth + 1, pt, q);
+    }
+    else
+    {
+        knn_search(p, mid + 1, hi, depth + 1, pt, q);
+        if (diff * diff <= knn_bound(q))
+            knn_search(p, lo, mid, depth + 1, pt, q);
+    }
+}
+
+int om_kdtree_k_nearest(const om_kdtree_t *tree, const double pt[3], int k,
+                        double max_dist, int64_t *ids, double *dists)
+{
+    if (k <= 0)
+        return 0;
+
+    knn_t q = {
+        .k = k,
+        .d_sq = (double*)malloc(k * sizeof(double)),
+        .ids = ids,
+        .max_d_sq = max_dist * max_dist,
+        .object_type = -1
+    };
+    knn_search(tree->points, 0, tree->num_points, 0, pt, &q);
+
+    // heap sort in place, leaves the closest first
+    int n = q.len;
+    for (int last = n - 1; last > 0; last--)
+    {
+        double d_sq = q.d_sq[0];
+        int64_t id = q.ids[0];
+        q.len = last;
+        knn_replace_top(&q, q.d_sq[last], q.ids[last]);
+        q.d_sq[last] = d_sq;
+        q.ids[last] = id;
+    }
+    if (dists)
+        for (int i = 0; i < n; i++)
+            dists[i] = sqrt(q.d_sq[i]);
+    free(q.d_sq);
+    return n;
+}
+
+int64_t om_kdtree_nearest_of_type(const om_kdtree_t *tree, const double pt[3],
+                                  int object_type, double max_dist,
+                                  double *dist)
+{
+    double d_sq;
+    int64_t id = -1;
+    knn_t q = {
+        .k = 1,
+        .d_sq = &d_sq,
+        .ids = &id,
+        .max_d_sq = max_dist * max_dist,
+        .object_type = object_type
+    };
+    knn_search(tree->points, 0, tree->num_points, 0, pt, &q);
+    if (dist)
+        *dist = q.len ? sqrt(d_sq) : DBL_MAX;
+    return q.len ? id : -1;
+}
+
+static void radius_search(const om_kdtree_point_t *p, int lo, int hi,
+                          int depth, const double pt[3], double r_sq,
+                          id_array_t *out)
+{
+    if (lo >= hi)
+        return;
+    int mid = lo + (hi - lo) / 2;
+    int axis = depth % 3;
+
+    if (dist_sq(pt, p[mid].pos) <= r_sq)
+        id_array_append(out, p[mid].id);
+
+    double diff = pt[axis] - p[mid].pos[axis];
+    if (diff < 0 || diff * diff <= r_sq)
+        radius_search(p, lo, mid, depth + 1, pt, r_sq, out);
+    if (diff >= 0 || diff * diff <= r_sq)
+        radius_search(p, mid + 1, hi, depth + 1, pt, r_sq, out);
+}
+
+int om_kdtree_radius(const om_kdtree_t *tree, const double pt[3],
+                     double radius, int64_t **ids)
+{
+    id_array_t out = { .ids = (int64_t*)malloc(16 * sizeof(int64_t)),
+                       .capacity = 16 };
+    radius_search(tree->points, 0, tree->num_points, 0, pt, radius * radius,
+                  &out);
+    *ids = out.ids;
+    return out.len;
+}
+
+static void box_search(const om_kdtree_point_t *p, int lo, int hi, int depth,
+                       const double min[3], const double max[3],
+                       id_array_t *out)
+{
+    if (lo >= hi)
+        return;
+    int mid = lo + (hi - lo) / 2;
+    int axis = depth % 3;
+    const double *pos = p[mid].pos;
+
+    if (pos[0] >= min[0] && pos[0] <= max[0] &&
+        pos[1] >= min[1] && pos[1] <= max[1] &&
+        pos[2] >= min[2] && pos[2] <= max[2])
+        id_array_append(out, p[mid].id);
+
+    if (min[axis] <= pos[axis])
+        box_search(p, lo, mid, depth + 1, min, max, out);
+    if (max[axis] >= pos[axis])
+        box_search(p, mid + 1, hi, depth + 1, min, max, out);
+}
+
+int om_kdtree_box(const om_kdtree_t *tree, const double min[3],
+                  const double max[3], int64_t **ids)
+{
+    id_array_t out = { .ids = (int64_t*)malloc(16 * sizeof(int64_t)),
+                       .capacity = 16 };
+    box_search(tree->points, 0, tree->num_points, 0, min, max, &out);
+    *ids = out.ids;
+    return out.len;
+}
@@ -0,0 +1,77 @@
+#ifndef __OBJECT_KDTREE_H
+#define __OBJECT_KDTREE_H
+
+#include <stdint.h>
+
+/*
+ * Static 3-d tree over object positions for the geometric queries of the
+ * client. The tree is rebuilt from scratch for every object list; it keeps
+ * ids rather than pointers, so results stay valid after the list is gone.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_kdtree_point
+{
+    double  pos[3];
+    int64_t id;
+    int32_t object_type;
+} om_kdtree_point_t;
+
+typedef struct _om_kdtree om_kdtree_t;
+
+om_kdtree_t *om_kdtree_new(void);
+
+void om_kdtree_destroy(om_kdtree_t *tree);
+
+/**
+ * om_kdtree_build:
+ * @tree The tree.
+ * @points malloc'd points; the tree takes them over and reorders them.
+ * @num_points Number of @points.
+ */
+void om_kdtree_build(om_kdtree_t *tree, om_kdtree_point_t *points,
+                     int num_points);
+
+/**
+ * om_kdtree_k_nearest:
+ * Returns: How many of the @k points nearest to @pt, no farther than
+ *          @max_dist, were written to @ids (and @dists, unless NULL),
+ *          closest first.
+ */
+int om_kdtree_k_nearest(const om_kdtree_t *tree, const double pt[3], int k,
+                        double max_dist, int64_t *ids, double *dists);
+
+/**
+ * om_kdtree_nearest_of_type:
+ * @object_type Only consider points of this type, or any type if < 0.
+ * Returns: The id of the point nearest to @pt and within @max_dist, or -1.
+ *          @dist is set to its distance, or DBL_MAX if there is none.
+ */
+int64_t om_kdtree_nearest_of_type(const om_kdtree_t *tree, const double pt[3],
+                                  int object_type, double max_dist,
+                                  double *dist);
+
+/**
+ * om_kdtree_radius:
+ * Returns: The number of points within @radius of @pt. Their ids are put
+ *          in *@ids, which is malloc'd (also when empty) and must be freed.
+ */
+int om_kdtree_radius(const om_kdtree_t *tree, const double pt[3],
+                     double radius, int64_t **ids);
+
+/**
+ * om_kdtree_box:
+ * Returns: The number of points inside the axis-aligned box from @min to
+ *          @max, bounds included, with their ids as for om_kdtree_radius().
+ */
+int om_kdtree_box(const om_kdtree_t *tree, const double min[3],
+                  const double max[3], int64_t **ids);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "object_list_assembler.h"
+
+struct _om_list_assembler
+{
+    int64_t utime;              // list being assembled, 0 if none
+    int32_t num_chunks;
+    int32_t received;           // distinct chunks received so far
+    unsigned char *have;        // have[i] set once chunk i arrived
+    int32_t covered;            // objects filled in so far
+    unsigned char *filled;      // filled[i] set once object i arrived
+    om_object_list_t *list;
+
+    int64_t dropped;
+};
+
+om_list_assembler_t *om_list_assembler_new(void)
+{
+    return (om_list_assembler_t*)calloc(1, sizeof(om_list_assembler_t));
+}
+
+static void _om_list_assembler_reset(om_list_assembler_t *a)
+{
+    if (a->list)
+    {
+        a->dropped++;
+        om_object_list_t_destroy(a->list);
+    }
+    free(a->have);
+    free(a->filled);
+    a->have = NULL;
+    a->filled = NULL;
+    a->list = NULL;
+    a->received = 0;
+    a->covered = 0;
+    a->num_chunks = 0;
+}
+
+void om_list_assembler_destroy(om_list_assembler_t *a)
+{
+    if (!a) return;
+    _om_list_assembler_reset(a);
+    free(a);
+}
+
+static int _om_chunk_is_valid(const om_object_list_chunk_t *chunk)
+{
+    return chunk->num_chunks > 0 &&
+        chunk->chunk_index >= 0 && chunk->chunk_index < chunk->num_chunks &&
+        chunk->first_index >= 0 && chunk->num_objects >= 0 &&
+        (int64_t)chunk->first_index + chunk->num_objects <= chunk->total_objects;
+}
+
+om_object_list_t *om_list_assembler_add(om_list_assembler_t *a,
+                                        const om_object_list_chunk_t *chunk)
+{
+    if (!_om_chunk_is_valid(chunk) || chunk->utime < a->utime)
+        return NULL;
+
+    if (chunk->utime > a->utime)
+    {
+        _om_list_assembler_reset(a);
+        a->utime = chunk->utime;
+        a->num_chunks = chunk->num_chunks;
+        a->have = (unsigned char*)calloc(chunk->num_chunks, 1);
+        a->filled = (unsigned char*)calloc(chunk->total_objects, 1);
+        a->list = (om_object_list_t*)calloc(1, sizeof(om_object_list_t));
+        a->list->utime = chunk->utime;
+        a->list->num_objects = chunk->total_objects;
+        a->list->objects = (om_object_t*)calloc(chunk->total_objects,
+                                                sizeof(om_object_t));
+    }
+
+    if (!a->list || chunk->num_chunks != a->num_chunks ||
+        chunk->total_objects != a->list->num_objects ||
+        a->have[chunk->chunk_index])
+        return NULL;
+
+    // chunks of one list never overlap; if these do, the list can't be
+    // trusted and is given up
+    for (int i = 0; i < chunk->num_objects; i++)
+        if (a->filled[chunk->first_index + i])
+        {
+            _om_list_assembler_reset(a);
+            return NULL;
+        }
+
+    for (int i = 0; i < chunk->num_objects; i++)
+    {
+        om_object_t *obj = &a->list->objects[chunk->first_index + i];
+        memcpy(obj, &chunk->objects[i], sizeof(om_object_t));
+        obj->label = strdup(chunk->objects[i].label ? chunk->objects[i].label : "");
+        a->filled[chunk->first_index + i] = 1;
+    }
+    a->covered += chunk->num_objects;
+    a->have[chunk->chunk_index] = 1;
+    a->received++;
+
+    if (a->received < a->num_chunks)
+        return NULL;
+    // all chunks are in but left a gap, the list can't complete
+    if (a->covered < a->list->num_objects)
+    {
+        _om_list_assembler_reset(a);
+        return NULL;
+    }
+
+    // complete; keep a->utime so late duplicates of this list are dropped
+    om_object_list_t *rtn = a->list;
+    a->list = NULL;
+    _om_list_assembler_reset(a);
+    return rtn;
+}
+
+int64_t om_list_assembler_get_dropped(const om_list_assembler_t *a)
+{
+    return a->dropped;
+}
@@ -0,0 +1,49 @@
+#ifndef __OBJECT_LIST_ASSEMBLER_H
+#define __OBJECT_LIST_ASSEMBLER_H
+
+#include <lcmtypes/om_object_list_t.h>
+#include <lcmtypes/om_object_list_chunk_t.h>
+
+/*
+ * Puts object lists that the server split into om_object_list_chunk_t
+ * messages (on OM_OL_CHUNK_CHANNEL) back together.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_list_assembler om_list_assembler_t;
+
+om_list_assembler_t *om_list_assembler_new(void);
+
+void om_list_assembler_destroy(om_list_assembler_t *assembler);
+
+/**
+ * om_list_assembler_add:
+ * @assembler The assembler.
+ * @chunk A received chunk.
+ * Returns: The complete list once the last missing chunk of it arrived,
+ *          to be freed with om_object_list_t_destroy(), or NULL.
+ *
+ * Chunks of a list older than the one being assembled are dropped. A chunk
+ * of a newer list abandons the one being assembled, so a lost chunk costs
+ * at most one list. So do chunks that overlap, or that leave a gap once
+ * all of them arrived: a list only completes with every object filled in
+ * exactly once.
+ */
+om_object_list_t *om_list_assembler_add(om_list_assembler_t *assembler,
+                                        const om_object_list_chunk_t *chunk);
+
+/**
+ * om_list_assembler_get_dropped:
+ * Returns: The number of lists abandoned because a chunk never arrived or
+ *          the chunks did not fit together.
+ */
+int64_t om_list_assembler_get_dropped(const om_list_assembler_t *assembler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
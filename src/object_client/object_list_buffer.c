@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <lcm/lcm_coretypes.h>
+
+#include "object_list_buffer.h"
+
+struct _om_list_buffer
+{
+    om_object_list_t list;
+    int capacity;           // objects allocated
+    int *label_capacity;    // bytes allocated for each label
+};
+
+om_list_buffer_t *om_list_buffer_new(void)
+{
+    return (om_list_buffer_t*)calloc(1, sizeof(om_list_buffer_t));
+}
+
+void om_list_buffer_destroy(om_list_buffer_t *b)
+{
+    if (!b) return;
+    for (int i = 0; i < b->capacity; i++)
+        free(b->list.objects[i].label);
+    free(b->list.objects);
+    free(b->label_capacity);
+    free(b);
+}
+
+om_object_list_t *om_list_buffer_get_list(om_list_buffer_t *b)
+{
+    return &b->list;
+}
+
+static void _om_list_buffer_reserve(om_list_buffer_t *b, int num_objects)
+{
+    if (num_objects <= b->capacity)
+        return;
+
+    int capacity = b->capacity ? b->capacity : 16;
+    while (capacity < num_objects)
+        capacity *= 2;
+
+    b->list.objects = (om_object_t*)realloc(b->list.objects,
+                                            capacity * sizeof(om_object_t));
+    b->label_capacity = (int*)realloc(b->label_capacity, capacity * sizeof(int));
+    for (int i = b->capacity; i < capacity; i++)
+    {
+        b->list.objects[i].label = NULL;
+        b->label_capacity[i] = 0;
+    }
+    b->capacity = capacity;
+}
+
+// makes room for a label of len bytes, terminator included, in object i
+static char *_om_list_buffer_label(om_list_buffer_t *b, int i, int len)
+{
+    if (len > b->label_capacity[i])
+    {
+        free(b->list.objects[i].label);
+        b->list.objects[i].label = (char*)malloc(len);
+        b->label_capacity[i] = len;
+    }
+    return b->list.objects[i].label;
+}
+
+/*
+ * Mirrors the generated decoder, field by field. The object array and the
+ * labels are the only parts that need memory, and both are reused.
+ */
+static int _om_object_decode(om_list_buffer_t *b, int i, const void *buf,
+                             int offset, int maxlen)
+{
+    om_object_t *p = &b->list.objects[i];
+    int pos = 0, thislen;
+
+    thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &p->utime, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &p->id, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __double_decode_array(buf, offset + pos, maxlen - pos, p->pos, 3);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __double_decode_array(buf, offset + pos, maxlen - pos, p->orientation, 4);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __double_decode_array(buf, offset + pos, maxlen - pos, p->bbox_min, 3);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __double_decode_array(buf, offset + pos, maxlen - pos, p->bbox_max, 3);
+    if (thislen < 0) return thislen; else pos += thislen;
+    thislen = __int16_t_decode_array(buf, offset + pos, maxlen - pos, &p->object_type, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+
+    // strings are their length, terminator included, then the bytes
+    int32_t len;
+    thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &len, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    if (len < 1 || len > maxlen - pos)
+        return -1;
+    char *label = _om_list_buffer_label(b, i, len);
+    memcpy(label, (const char*)buf + offset + pos, len);
+    label[len - 1] = '\0';
+    pos += len;
+
+    return pos;
+}
+
+int om_list_buffer_decode(om_list_buffer_t *b, const void *data, int size)
+{
+    int pos = 0, thislen;
+    int64_t hash;
+
+    b->list.num_objects = 0;
+
+    thislen = __int64_t_decode_array(data, pos, size - pos, &hash, 1);
+    if (thislen < 0 || hash != __om_object_list_t_get_hash())
+        return -1;
+    pos += thislen;
+
+    thislen = __int64_t_decode_array(data, pos, size - pos, &b->list.utime, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+
+    int32_t num_objects;
+    thislen = __int32_t_decode_array(data, pos, size - pos, &num_objects, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    if (num_objects < 0)
+        return -1;
+
+    _om_list_buffer_reserve(b, num_objects);
+    for (int i = 0; i < num_objects; i++)
+    {
+        thislen = _om_object_decode(b, i, data, pos, size - pos);
+        if (thislen < 0)
+            return thislen;
+        pos += thislen;
+    }
+    b->list.num_objects = num_objects;
+    return 0;
+}
+
+void om_list_buffer_copy(om_list_buffer_t *b, const om_object_list_t *list)
+{
+    _om_list_buffer_reserve(b, list->num_objects);
+    b->list.utime = list->utime;
+    for (int i = 0; i < list->num_objects; i++)
+    {
+        const om_object_t *src = &list->objects[i];
+        om_object_t *dst = &b->list.objects[i];
+        const char *src_label = src->label ? src->label : "";
+        int len = strlen(src_label) + 1;
+
+        char *label = _om_list_buffer_label(b, i, len);
+        memcpy(dst, src, sizeof(om_object_t));
+        dst->label = label;
+        memcpy(label, src_label, len);
+    }
+    b->list.num_objects = list->num_objects;
+}
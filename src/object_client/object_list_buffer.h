@@ -0,0 +1,50 @@
+#ifndef __OBJECT_LIST_BUFFER_H
+#define __OBJECT_LIST_BUFFER_H
+
+#include <lcmtypes/om_object_list_t.h>
+
+/*
+ * An om_object_list_t that keeps its memory from one list to the next.
+ * The object array and every label only grow, so once the world stopped
+ * growing, taking in another list allocates nothing.
+ *
+ * The list belongs to the buffer; never om_object_list_t_destroy() it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_list_buffer om_list_buffer_t;
+
+om_list_buffer_t *om_list_buffer_new(void);
+
+void om_list_buffer_destroy(om_list_buffer_t *buffer);
+
+/**
+ * om_list_buffer_decode:
+ * @buffer The buffer.
+ * @data An LCM encoded om_object_list_t, as received on a raw subscription.
+ * @size Size of @data in bytes.
+ * Returns: 0 on success, < 0 if @data is not a valid om_object_list_t.
+ *
+ * Decodes straight into the buffer's list, without the temporary message
+ * a typed subscription would decode into first. The list is empty after a
+ * failure.
+ */
+int om_list_buffer_decode(om_list_buffer_t *buffer, const void *data,
+                          int size);
+
+/**
+ * om_list_buffer_copy:
+ * Makes the buffer's list a copy of @list.
+ */
+void om_list_buffer_copy(om_list_buffer_t *buffer, const om_object_list_t *list);
+
+om_object_list_t *om_list_buffer_get_list(om_list_buffer_t *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef __OBJECT_MODEL_HPP
+#define __OBJECT_MODEL_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "object_client.h"
+
+/*
+ * C++11 layer over the object client.
+ *
+ * WorldModel and Snapshot own their C counterparts and release them on
+ * destruction; both are move-only. Everything read through a Snapshot
+ * points into it, so lookups and queries copy nothing and allocate
+ * nothing, and stay valid as long as the Snapshot lives.
+ *
+ * Queries take any callable as filter. Being templates, the filter is
+ * inlined into the loop instead of being called through a pointer.
+ *
+ *   object_model::WorldModel world = object_model::WorldModel::create();
+ *   object_model::Snapshot snap = world.snapshot();
+ *   if (object_model::ObjectRef obj = snap.find(id))
+ *       use(obj->pos);
+ *   snap.for_each_in_radius(x, y, z, 5.0,
+ *       [](const object_model::Object &o) { return o.object_type == 3; },
+ *       [&](const object_model::Object &o) { nearby.push_back(o.id); });
+ */
+
+namespace object_model {
+
+typedef om_object_t Object;
+
+/**
+ * A contiguous, read-only range of objects owned by someone else.
+ */
+class ObjectSpan
+{
+public:
+    typedef const Object *iterator;
+
+    ObjectSpan() : data_(nullptr), size_(0) {}
+    ObjectSpan(const Object *data, std::size_t size) : data_(data), size_(size) {}
+
+    const Object *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    iterator begin() const { return data_; }
+    iterator end() const { return data_ + size_; }
+    const Object &operator[](std::size_t i) const { return data_[i]; }
+
+private:
+    const Object *data_;
+    std::size_t size_;
+};
+
+/**
+ * An object that may be missing, like std::optional<const Object &>.
+ */
+class ObjectRef
+{
+public:
+    ObjectRef() : obj_(nullptr) {}
+    explicit ObjectRef(const Object *obj) : obj_(obj) {}
+
+    bool has_value() const { return obj_ != nullptr; }
+    explicit operator bool() const { return obj_ != nullptr; }
+
+    const Object &operator*() const { return *obj_; }
+    const Object *operator->() const { return obj_; }
+    const Object &value() const
+    {
+        if (!obj_)
+            throw std::out_of_range("object_model: no such object");
+        return *obj_;
+    }
+
+private:
+    const Object *obj_;
+};
+
+/**
+ * Owns an object copied out by the C API, as returned by
+ * om_get_object_by_id().
+ */
+struct ObjectDeleter
+{
+    void operator()(Object *obj) const { om_object_t_destroy(obj); }
+};
+typedef std::unique_ptr<Object, ObjectDeleter> ObjectPtr;
+
+/**
+ * A consistent view of the world at one point in time, see
+ * om_acquire_snapshot(). Empty if none could be taken.
+ */
+class Snapshot
+{
+public:
+    Snapshot() : snap_(nullptr) {}
+    explicit Snapshot(const om_snapshot_t *snap) : snap_(snap) {}
+    ~Snapshot() { om_release_snapshot(snap_); }
+
+    Snapshot(Snapshot &&other) : snap_(other.snap_) { other.snap_ = nullptr; }
+    Snapshot &operator=(Snapshot &&other)
+    {
+        if (this != &other)
+        {
+            om_release_snapshot(snap_);
+            snap_ = other.snap_;
+            other.snap_ = nullptr;
+        }
+        return *this;
+    }
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    explicit operator bool() const { return snap_ != nullptr; }
+    const om_snapshot_t *get() const { return snap_; }
+
+    int64_t utime() const { return snap_ ? om_snapshot_get_utime(snap_) : 0; }
+    int64_t version() const { return snap_ ? om_snapshot_get_version(snap_) : 0; }
+
+    ObjectSpan objects() const
+    {
+        if (!snap_)
+            return ObjectSpan();
+        int n;
+        const Object *objects = om_snapshot_get_objects(snap_, &n);
+        return ObjectSpan(objects, n);
+    }
+
+    ObjectRef find(int64_t id) const
+    {
+        return ObjectRef(snap_ ? om_snapshot_get_object_by_id(snap_, id) : nullptr);
+    }
+
+    /** Returns the first object pred accepts. */
+    template <typename Pred>
+    ObjectRef find_if(Pred pred) const
+    {
+        for (const Object &obj : objects())
+            if (pred(obj))
+                return ObjectRef(&obj);
+        return ObjectRef();
+    }
+
+    template <typename Pred>
+    std::size_t count_if(Pred pred) const
+    {
+        std::size_t n = 0;
+        for (const Object &obj : objects())
+            if (pred(obj))
+                n++;
+        return n;
+    }
+
+    /** Calls f for every object pred accepts. */
+    template <typename Pred, typename F>
+    void for_each_if(Pred pred, F f) const
+    {
+        for (const Object &obj : objects())
+            if (pred(obj))
+                f(obj);
+    }
+
+    /** Calls f for every object within radius of (x, y, z) that pred accepts. */
+    template <typename Pred, typename F>
+    void for_each_in_radius(double x, double y, double z, double radius,
+                            Pred pred, F f) const
+    {
+        double r2 = radius * radius;
+        for (const Object &obj : objects())
+        {
+            double dx = obj.pos[0] - x, dy = obj.pos[1] - y, dz = obj.pos[2] - z;
+            if (dx*dx + dy*dy + dz*dz <= r2 && pred(obj))
+                f(obj);
+        }
+    }
+
+    /**
+     * Returns the object nearest to (x, y, z), no farther than max_dist,
+     * that pred accepts. Sets *dist if given and an object was found.
+     */
+    template <typename Pred>
+    ObjectRef nearest_if(double x, double y, double z, double max_dist,
+                         Pred pred, double *dist = nullptr) const
+    {
+        const Object *best = nullptr;
+        double best_d2 = max_dist * max_dist;
+        for (const Object &obj : objects())
+        {
+            double dx = obj.pos[0] - x, dy = obj.pos[1] - y, dz = obj.pos[2] - z;
+            double d2 = dx*dx + dy*dy + dz*dz;
+            if (d2 <= best_d2 && pred(obj))
+            {
+                best = &obj;
+                best_d2 = d2;
+            }
+        }
+        if (best && dist)
+            *dist = std::sqrt(best_d2);
+        return ObjectRef(best);
+    }
+
+private:
+    const om_snapshot_t *snap_;
+};
+
+/**
+ * Owns an ObjectWorldModel.
+ */
+class WorldModel
+{
+public:
+    static WorldModel create() { return WorldModel(check(om_new())); }
+    static WorldModel create_threaded() { return WorldModel(check(om_new_threaded())); }
+    static WorldModel create_shm(const char *shm_name = nullptr)
+    {
+        return WorldModel(check(om_new_shm(shm_name)));
+    }
+
+    /** Takes ownership of om. */
+    explicit WorldModel(ObjectWorldModel *om) : om_(om) {}
+    ~WorldModel() { om_destroy(om_); }
+
+    WorldModel(WorldModel &&other) : om_(other.om_) { other.om_ = nullptr; }
+    WorldModel &operator=(WorldModel &&other)
+    {
+        if (this != &other)
+        {
+            om_destroy(om_);
+            om_ = other.om_;
+            other.om_ = nullptr;
+        }
+        return *this;
+    }
+    WorldModel(const WorldModel &) = delete;
+    WorldModel &operator=(const WorldModel &) = delete;
+
+    ObjectWorldModel *get() const { return om_; }
+
+    /** Empty for shared memory readers, see om_acquire_snapshot(). */
+    Snapshot snapshot() const { return Snapshot(om_acquire_snapshot(om_)); }
+
+    /**
+     * Returns a copy of the object, including our own unconfirmed updates
+     * (om_set_overlay()). Prefer snapshot().find(), which copies nothing.
+     */
+    ObjectPtr get_object(int64_t id) const
+    {
+        return ObjectPtr(om_get_object_by_id(om_, id));
+    }
+
+    int add(Object &obj) { return om_add_object(om_, &obj); }
+    int add(Object *objects, int num_objects)
+    {
+        return om_add_objects(om_, objects, num_objects);
+    }
+    void update(Object &obj) { om_update_object(om_, &obj); }
+
+private:
+    static ObjectWorldModel *check(ObjectWorldModel *om)
+    {
+        if (!om)
+            throw std::runtime_error("object_model: could not create the world model");
+        return om;
+    }
+
+    ObjectWorldModel *om_;
+};
+
+} // namespace object_model
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <glib.h>
+
+#include "object_publish_queue.h"
+
+/*
+ * A bounded multi-producer, multi-consumer ring after Dmitry Vyukov. Every
+ * cell carries a sequence number: pos while free for the push that claims
+ * position pos, pos + 1 once filled, and pos + capacity when popped, free
+ * for the push one lap later. Pushes and pops claim their position with a
+ * compare-and-swap on their end's counter and never wait for each other.
+ *
+ * The semaphores only wake the sleeping: items counts pushes for the
+ * consumer, space is posted after a pop while a blocked pusher waits.
+ */
+
+typedef struct _cell
+{
+    volatile guint seq;
+    om_object_t obj;
+} cell_t;
+
+struct _om_publish_queue
+{
+    cell_t *cells;
+    guint mask;
+    om_queue_policy_t policy;
+
+    // the two ends are written by different threads, keep them apart
+    volatile guint enqueue_pos;
+    char pad1[64];
+    volatile guint dequeue_pos;
+    char pad2[64];
+
+    volatile gint blocked;      // pushers waiting for space
+    volatile gint dropped;
+    sem_t items;
+    sem_t space;
+};
+
+om_publish_queue_t *om_publish_queue_new(int capacity, om_queue_policy_t policy)
+{
+    guint size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    om_publish_queue_t *q =
+        (om_publish_queue_t*)calloc(1, sizeof(om_publish_queue_t));
+    q->cells = (cell_t*)calloc(size, sizeof(cell_t));
+    for (guint i = 0; i < size; i++)
+        q->cells[i].seq = i;
+    q->mask = size - 1;
+    q->policy = policy;
+    sem_init(&q->items, 0, 0);
+    sem_init(&q->space, 0, 0);
+    return q;
+}
+
+void om_publish_queue_destroy(om_publish_queue_t *q)
+{
+    if (!q) return;
+    om_object_t obj;
+    while (om_publish_queue_pop(q, &obj))
+        free(obj.label);
+    sem_destroy(&q->items);
+    sem_destroy(&q->space);
+    free(q->cells);
+    free(q);
+}
+
+static int try_push(om_publish_queue_t *q, const om_object_t *obj)
+{
+    cell_t *cell;
+    guint pos = g_atomic_int_get((volatile gint*)&q->enqueue_pos);
+    for (;;)
+    {
+        cell = &q->cells[pos & q->mask];
+        guint seq = g_atomic_int_get((volatile gint*)&cell->seq);
+        gint dif = (gint)(seq - pos);
+        if (dif == 0)
+        {
+            if (g_atomic_int_compare_and_exchange((volatile gint*)&q->enqueue_pos,
+                                                  pos, pos + 1))
+                break;
+        }
+        else if (dif < 0)
+            return 0;   // a lap behind: full
+        pos = g_atomic_int_get((volatile gint*)&q->enqueue_pos);
+    }
+    cell->obj = *obj;
+    __sync_synchronize();
+    g_atomic_int_set((volatile gint*)&cell->seq, pos + 1);
+    return 1;
+}
+
+int om_publish_queue_pop(om_publish_queue_t *q, om_object_t *obj)
+{
+    cell_t *cell;
+    guint pos = g_atomic_int_get((volatile gint*)&q->dequeue_pos);
+    for (;;)
+    {
+        cell = &q->cells[pos & q->mask];
+        guint seq = g_atomic_int_get((volatile gint*)&cell->seq);
+        gint dif = (gint)(seq - (pos + 1));
+        if (dif == 0)
+        {
+            if (g_atomic_int_compare_and_exchange((volatile gint*)&q->dequeue_pos,
+                                                  pos, pos + 1))
+                break;
+        }
+        else if (dif < 0)
+            return 0;   // not filled yet: empty
+        pos = g_atomic_int_get((volatile gint*)&q->dequeue_pos);
+    }
+    *obj = cell->obj;
+    __sync_synchronize();
+    g_atomic_int_set((volatile gint*)&cell->seq, pos + q->mask + 1);
+
+    if (g_atomic_int_get(&q->blocked))
+        sem_post(&q->space);
+    return 1;
+}
+
+void om_publish_queue_push(om_publish_queue_t *q, const om_object_t *obj)
+{
+    om_object_t copy = *obj;
+    copy.label = strdup(obj->label ? obj->label : "");
+
+    while (!try_push(q, &copy))
+    {
+        if (q->policy == OM_QUEUE_DROP_OLDEST)
+        {
+            om_object_t old;
+            if (om_publish_queue_pop(q, &old))
+            {
+                free(old.label);
+                g_atomic_int_inc(&q->dropped);
+            }
+            continue;
+        }
+
+        // announce ourselves before the last try, so a pop right after it
+        // posts space for us
+        g_atomic_int_inc(&q->blocked);
+        if (!try_push(q, &copy))
+        {
+            while (sem_wait(&q->space) < 0 && errno == EINTR)
+                ;
+            g_atomic_int_add(&q->blocked, -1);
+            continue;
+        }
+        g_atomic_int_add(&q->blocked, -1);
+        break;
+    }
+    sem_post(&q->items);
+}
+
+void om_publish_queue_wait(om_publish_queue_t *q)
+{
+    while (sem_wait(&q->items) < 0 && errno == EINTR)
+        ;
+}
+
+void om_publish_queue_wake(om_publish_queue_t *q)
+{
+    sem_post(&q->items);
+}
+
+int64_t om_publish_queue_get_dropped(om_publish_queue_t *q)
+{
+    return g_atomic_int_get(&q->dropped);
+}
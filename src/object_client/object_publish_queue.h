@@ -0,0 +1,61 @@
+#ifndef __OBJECT_PUBLISH_QUEUE_H
+#define __OBJECT_PUBLISH_QUEUE_H
+
+#include <lcmtypes/om_object_t.h>
+
+/*
+ * Bounded queue of object updates between the threads that make them and
+ * the thread that publishes them (om_set_async_publish()). Any number of
+ * threads may push and pop; neither takes a lock. Only a push into a full
+ * queue with OM_QUEUE_BLOCK waits, as does om_publish_queue_wait().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    OM_QUEUE_DROP_OLDEST,   // a push into a full queue drops the oldest update
+    OM_QUEUE_BLOCK          // a push into a full queue waits for room
+} om_queue_policy_t;
+
+typedef struct _om_publish_queue om_publish_queue_t;
+
+/**
+ * om_publish_queue_new:
+ * @capacity Number of updates the queue holds, rounded up to a power of 2.
+ */
+om_publish_queue_t *om_publish_queue_new(int capacity, om_queue_policy_t policy);
+
+/* Frees the updates still queued along with the queue. */
+void om_publish_queue_destroy(om_publish_queue_t *q);
+
+/**
+ * om_publish_queue_push:
+ * Queues a copy of @obj.
+ */
+void om_publish_queue_push(om_publish_queue_t *q, const om_object_t *obj);
+
+/**
+ * om_publish_queue_pop:
+ * @obj (returned) The oldest update; its label is malloc'd and now the
+ *      caller's.
+ * Returns: 0 if the queue was empty.
+ */
+int om_publish_queue_pop(om_publish_queue_t *q, om_object_t *obj);
+
+/* Waits until something was pushed since the last wait, or
+ * om_publish_queue_wake() was called. */
+void om_publish_queue_wait(om_publish_queue_t *q);
+
+void om_publish_queue_wake(om_publish_queue_t *q);
+
+/* Returns the number of updates dropped by OM_QUEUE_DROP_OLDEST so far. */
+int64_t om_publish_queue_get_dropped(om_publish_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __OBJECT_SHM_H
+#define __OBJECT_SHM_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the POSIX shared memory segment that object-server can publish
+ * the world model into (object-server --shm), for readers on the same host.
+ *
+ * The segment is a header followed by two equally sized buffers. Each
+ * buffer holds a fixed-layout record per object, sorted by id, followed
+ * by a table of NUL-terminated labels. The server always writes the
+ * buffer that is not active, then flips header->active. Every buffer is
+ * guarded by a sequence counter that is odd while the buffer is written,
+ * so a reader that raced with the writer notices and retries.
+ *
+ * When the world outgrows the segment the server creates a larger one
+ * under the same name and marks the old one stale; readers then reopen.
+ */
+
+#define OM_SHM_DEFAULT_NAME     "/object_model"
+#define OM_SHM_MAGIC            0x4f4d5348  // "OMSH"
+#define OM_SHM_LAYOUT_VERSION   1
+
+typedef struct _om_shm_object {
+    int64_t  utime;
+    int64_t  id;
+    double   pos[3];
+    double   orientation[4];
+    double   bbox_min[3];
+    double   bbox_max[3];
+    int16_t  object_type;
+    int16_t  reserved;
+    uint32_t label_offset;  // into the label table of the same buffer
+} om_shm_object_t;
+
+typedef struct _om_shm_buffer {
+    volatile uint32_t seq;
+    uint32_t num_objects;
+    int64_t  utime;         // utime of the world model when written
+    int64_t  version;       // store version of the server when written
+    // followed by om_shm_object_t objects[max_objects]
+    // and char labels[label_capacity]
+} om_shm_buffer_t;
+
+typedef struct _om_shm_header {
+    uint32_t magic;
+    uint32_t layout_version;
+    uint32_t max_objects;
+    uint32_t label_capacity;
+    uint64_t buffer_size;   // bytes per buffer, including om_shm_buffer_t
+
+    volatile uint32_t active;       // buffer readers should use
+    volatile uint32_t stale;        // set once a replacement segment exists
+    volatile uint64_t generation;   // bumped on every publish
+} om_shm_header_t;
+
+static inline uint64_t
+om_shm_segment_size(uint32_t max_objects, uint32_t label_capacity)
+{
+    uint64_t buffer_size = sizeof(om_shm_buffer_t) +
+        (uint64_t)max_objects * sizeof(om_shm_object_t) + label_capacity;
+    buffer_size = (buffer_size + 63) & ~(uint64_t)63;
+    return sizeof(om_shm_header_t) + 2 * buffer_size;
+}
+
+static inline om_shm_buffer_t *
+om_shm_buffer(const om_shm_header_t *hdr, uint32_t idx)
+{
+    return (om_shm_buffer_t *)((char *)hdr + sizeof(om_shm_header_t) +
+                               idx * hdr->buffer_size);
+}
+
+static inline om_shm_object_t *
+om_shm_buffer_objects(om_shm_buffer_t *buf)
+{
+    return (om_shm_object_t *)(buf + 1);
+}
+
+static inline char *
+om_shm_buffer_labels(const om_shm_header_t *hdr, om_shm_buffer_t *buf)
+{
+    return (char *)(om_shm_buffer_objects(buf) + hdr->max_objects);
+}
+
+#endif
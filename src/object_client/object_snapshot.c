@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "object_snapshot.h"
+
+/*
+ * Readers take a reference on slot->current without a lock, so a replaced
+ * snapshot may only lose the slot's reference once no reader can still be
+ * between loading slot->current and taking its reference.
+ *
+ * For that readers announce themselves in one of two counters, picked by
+ * the parity of slot->epoch, for the few instructions that takes. The
+ * writer swaps in the new snapshot, then bumps the epoch, so new readers
+ * move to the other counter and the old one drains.
+ *
+ * A reader that loaded the replaced snapshot announced itself before the
+ * swap, but it may have done so in either counter: it can stall after
+ * checking the epoch until later swaps moved the epoch on. So a retired
+ * snapshot is kept until each counter has been seen at zero after it was
+ * replaced. That is checked again on every publish rather than waited for.
+ */
+
+struct _om_snapshot_pool
+{
+    GMutex *mutex;
+    volatile gint refcount;     // owner, plus one per snapshot in use
+    gboolean closed;            // owner is gone, free snapshots when released
+    om_snapshot_t *free;
+};
+
+om_snapshot_pool_t *om_snapshot_pool_new(void)
+{
+    om_snapshot_pool_t *pool =
+        (om_snapshot_pool_t*)calloc(1, sizeof(om_snapshot_pool_t));
+    pool->mutex = g_mutex_new();
+    pool->refcount = 1;
+    return pool;
+}
+
+static void snapshot_free(om_snapshot_t *snap)
+{
+    om_list_buffer_destroy(snap->buffer);
+    om_object_index_destroy(snap->index);
+    free(snap);
+}
+
+static void pool_unref(om_snapshot_pool_t *pool)
+{
+    if (!g_atomic_int_dec_and_test(&pool->refcount))
+        return;
+    while (pool->free)
+    {
+        om_snapshot_t *snap = pool->free;
+        pool->free = snap->next;
+        snapshot_free(snap);
+    }
+    g_mutex_free(pool->mutex);
+    free(pool);
+}
+
+void om_snapshot_pool_close(om_snapshot_pool_t *pool)
+{
+    g_mutex_lock(pool->mutex);
+    pool->closed = TRUE;
+    g_mutex_unlock(pool->mutex);
+    pool_unref(pool);
+}
+
+om_snapshot_t *om_snapshot_pool_get(om_snapshot_pool_t *pool)
+{
+    g_mutex_lock(pool->mutex);
+    om_snapshot_t *snap = pool->free;
+    if (snap)
+        pool->free = snap->next;
+    g_mutex_unlock(pool->mutex);
+
+    if (!snap)
+    {
+        snap = (om_snapshot_t*)calloc(1, sizeof(om_snapshot_t));
+        snap->buffer = om_list_buffer_new();
+        snap->ol = om_list_buffer_get_list(snap->buffer);
+        snap->index = om_object_index_new();
+        snap->pool = pool;
+    }
+    g_atomic_int_inc(&pool->refcount);
+    snap->refcount = 1;
+    snap->next = NULL;
+    return snap;
+}
+
+void om_snapshot_unref(om_snapshot_t *snap)
+{
+    if (!g_atomic_int_dec_and_test(&snap->refcount))
+        return;
+
+    om_snapshot_pool_t *pool = snap->pool;
+    g_mutex_lock(pool->mutex);
+    if (pool->closed)
+        snapshot_free(snap);
+    else
+    {
+        snap->next = pool->free;
+        pool->free = snap;
+    }
+    g_mutex_unlock(pool->mutex);
+    pool_unref(pool);
+}
+
+// drops the references to retired snapshots no reader can still pick up
+static void slot_reclaim(om_snapshot_slot_t *slot)
+{
+    // one reading serves every snapshot, all were replaced before it
+    gboolean idle[2] = { !g_atomic_int_get(&slot->readers[0]),
+                         !g_atomic_int_get(&slot->readers[1]) };
+    om_snapshot_t **link = &slot->retired;
+    while (*link)
+    {
+        om_snapshot_t *snap = *link;
+        snap->drained[0] |= idle[0];
+        snap->drained[1] |= idle[1];
+        if (snap->drained[0] && snap->drained[1])
+        {
+            *link = snap->next;
+            om_snapshot_unref(snap);
+        }
+        else
+            link = &snap->next;
+    }
+}
+
+void om_snapshot_slot_publish(om_snapshot_slot_t *slot, om_snapshot_t *snap)
+{
+    om_snapshot_t *old = slot->current;
+    g_atomic_pointer_set(&slot->current, snap);
+    if (old)
+    {
+        old->drained[0] = old->drained[1] = FALSE;
+        old->next = slot->retired;
+        slot->retired = old;
+        g_atomic_int_inc(&slot->epoch);
+    }
+    slot_reclaim(slot);
+}
+
+om_snapshot_t *om_snapshot_slot_acquire(om_snapshot_slot_t *slot)
+{
+    for (;;)
+    {
+        gint epoch = g_atomic_int_get(&slot->epoch);
+        volatile gint *readers = &slot->readers[epoch & 1];
+        g_atomic_int_inc(readers);
+        if (g_atomic_int_get(&slot->epoch) == epoch)
+        {
+            om_snapshot_t *snap = (om_snapshot_t*)g_atomic_pointer_get(&slot->current);
+            if (snap)
+                g_atomic_int_inc(&snap->refcount);
+            g_atomic_int_add(readers, -1);
+            return snap;
+        }
+        // a publish came in between, let the old counter drain
+        g_atomic_int_add(readers, -1);
+    }
+}
+
+void om_snapshot_slot_clear(om_snapshot_slot_t *slot)
+{
+    while (slot->retired)
+    {
+        om_snapshot_t *snap = slot->retired;
+        slot->retired = snap->next;
+        om_snapshot_unref(snap);
+    }
+    if (slot->current)
+        om_snapshot_unref(slot->current);
+    slot->current = NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef __OBJECT_SNAPSHOT_H
+#define __OBJECT_SNAPSHOT_H
+
+#include <glib.h>
+#include <lcmtypes/om_object_list_t.h>
+
+#include "object_list_buffer.h"
+#include "object_index.h"
+
+/*
+ * Worlds handed to readers without a lock (om_acquire_snapshot()). A
+ * snapshot holds one object list and its id index, and is reference
+ * counted; released snapshots go back to their pool and are reused,
+ * buffers included. A slot holds the current snapshot: one writer at a
+ * time publishes into it, while any number of readers acquire from it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _om_snapshot om_snapshot_t;
+typedef struct _om_snapshot_pool om_snapshot_pool_t;
+
+struct _om_snapshot
+{
+    volatile gint refcount;
+    om_list_buffer_t *buffer;
+    om_object_list_t *ol;       // the list in buffer
+    om_object_index_t *index;
+    int64_t version;
+    gboolean drained[2];        // readers of that parity seen gone since retired
+    om_snapshot_t *next;        // in the retired list or the pool
+    om_snapshot_pool_t *pool;
+};
+
+typedef struct _om_snapshot_slot
+{
+    om_snapshot_t *volatile current;
+    volatile gint epoch;
+    volatile gint readers[2];   // readers acquiring, by epoch parity
+    om_snapshot_t *retired;     // replaced, maybe still being acquired
+} om_snapshot_slot_t;
+
+om_snapshot_pool_t *om_snapshot_pool_new(void);
+
+/* Drops the owner's reference; snapshots still out are freed when
+ * released. */
+void om_snapshot_pool_close(om_snapshot_pool_t *pool);
+
+/**
+ * om_snapshot_pool_get:
+ * Returns: An unused snapshot with a single reference, for the caller to
+ *          fill in.
+ */
+om_snapshot_t *om_snapshot_pool_get(om_snapshot_pool_t *pool);
+
+void om_snapshot_unref(om_snapshot_t *snap);
+
+/**
+ * om_snapshot_slot_publish:
+ * @slot The slot, zero filled before the first use.
+ * @snap The new current snapshot; the slot takes over the caller's
+ *       reference.
+ *
+ * Replaces the current snapshot. The replaced one is kept until no reader
+ * can still be acquiring it. Calls must not overlap.
+ */
+void om_snapshot_slot_publish(om_snapshot_slot_t *slot, om_snapshot_t *snap);
+
+/**
+ * om_snapshot_slot_acquire:
+ * Returns: The current snapshot with a reference for the caller, or NULL
+ *          if none was published yet. Safe from any thread at any time.
+ */
+om_snapshot_t *om_snapshot_slot_acquire(om_snapshot_slot_t *slot);
+
+/* Drops the slot's references, once no reader uses the slot any more. */
+void om_snapshot_slot_clear(om_snapshot_slot_t *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Checks om_bvh_raycast() against testing the ray against every box, on
+ * random worlds of rotated and degenerate boxes and random rays, some of
+ * them starting inside boxes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include "object_bvh.h"
+
+#define NUM_WORLDS 20
+#define NUM_BOXES 1000
+#define NUM_RAYS 2000
+#define WORLD_SIZE 100.0
+
+static double uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * (rand() / (double)RAND_MAX);
+}
+
+// entry distance of the ray into the box, or -1, worked out in the box
+// frame one slab at a time
+static double brute_hit(const om_bvh_box_t *box, const double o[3],
+                        const double d[3])
+{
+    double rel[3], lo[3], ld[3];
+    for (int i = 0; i < 3; i++)
+        rel[i] = o[i] - box->pos[i];
+    for (int i = 0; i < 3; i++)
+    {
+        lo[i] = ld[i] = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            lo[i] += box->rot[3*j + i] * rel[j];
+            ld[i] += box->rot[3*j + i] * d[j];
+        }
+    }
+
+    double enter = -INFINITY, leave = INFINITY;
+    for (int i = 0; i < 3; i++)
+    {
+        if (fabs(ld[i]) < 1e-12)
+        {
+            if (lo[i] < box->min[i] || lo[i] > box->max[i])
+                return -1;
+            continue;
+        }
+        double t1 = (box->min[i] - lo[i]) / ld[i];
+        double t2 = (box->max[i] - lo[i]) / ld[i];
+        if (t1 > t2)
+        {
+            double t = t1;
+            t1 = t2;
+            t2 = t;
+        }
+        if (t1 > enter) enter = t1;
+        if (t2 < leave) leave = t2;
+    }
+    return enter <= leave && enter >= 0 ? enter : -1;
+}
+
+static void random_box(om_bvh_box_t *box, int64_t id)
+{
+    double pos[3] = { uniform(0, WORLD_SIZE), uniform(0, WORLD_SIZE),
+                      uniform(0, 5) };
+    double q[4] = { uniform(-1, 1), uniform(-1, 1), uniform(-1, 1),
+                    uniform(-1, 1) };
+    double bmin[3], bmax[3];
+    for (int i = 0; i < 3; i++)
+    {
+        bmin[i] = uniform(-2, -0.1);
+        bmax[i] = uniform(0.1, 2);
+    }
+    // some objects are points, which become small cubes
+    if (id % 10 == 0)
+    {
+        memset(bmin, 0, sizeof(bmin));
+        memset(bmax, 0, sizeof(bmax));
+    }
+    om_bvh_box_set(box, pos, q, bmin, bmax, id);
+}
+
+int main(int argc, char **argv)
+{
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+
+    om_bvh_t *bvh = om_bvh_new();
+    om_bvh_box_t *all = (om_bvh_box_t*)malloc(NUM_BOXES * sizeof(om_bvh_box_t));
+    int failed = 0, hits = 0;
+
+    for (int world = 0; world < NUM_WORLDS && !failed; world++)
+    {
+        // a few worlds are tiny, down to empty
+        int n = world < 3 ? world : NUM_BOXES;
+        for (int i = 0; i < n; i++)
+            random_box(&all[i], i + 1);
+
+        // the hierarchy takes over and reorders its copy
+        om_bvh_box_t *boxes = (om_bvh_box_t*)malloc((n+1) * sizeof(om_bvh_box_t));
+        memcpy(boxes, all, n * sizeof(om_bvh_box_t));
+        om_bvh_build(bvh, boxes, n);
+
+        for (int r = 0; r < NUM_RAYS; r++)
+        {
+            double o[3] = { uniform(-10, WORLD_SIZE + 10),
+                            uniform(-10, WORLD_SIZE + 10), uniform(-1, 6) };
+            // start inside a box now and then
+            if (n && r % 7 == 0)
+                memcpy(o, all[rand() % n].pos, sizeof(o));
+            double dir[3] = { uniform(-1, 1), uniform(-1, 1), uniform(-0.2, 0.2) };
+            // and run along the axes too
+            if (r % 11 == 0)
+                dir[1] = dir[2] = 0;
+            double len = sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+            if (len == 0)
+                continue;
+            double d[3] = { dir[0] / len, dir[1] / len, dir[2] / len };
+            double max_dist = r % 3 ? INFINITY : uniform(1, 50);
+
+            double want = max_dist;
+            int64_t want_id = -1;
+            for (int i = 0; i < n; i++)
+            {
+                double t = brute_hit(&all[i], o, d);
+                if (t >= 0 && t < want)
+                {
+                    want = t;
+                    want_id = all[i].id;
+                }
+            }
+
+            double got = -1;
+            int64_t got_id = om_bvh_raycast(bvh, o, dir, max_dist, &got);
+
+            // boxes entered at the same distance may come out either way
+            if ((got_id < 0) != (want_id < 0) ||
+                (want_id >= 0 && fabs(got - want) > 1e-9))
+            {
+                fprintf(stderr, "world %d ray %d: got %"PRId64" at %g, "
+                        "want %"PRId64" at %g\n", world, r,
+                        got_id, got, want_id, want);
+                failed = 1;
+                break;
+            }
+            hits += want_id >= 0;
+        }
+    }
+
+    om_bvh_destroy(bvh);
+    free(all);
+    if (!failed)
+        printf("OK, %d hits\n", hits);
+    return failed;
+}
@@ -2,7 +2,7 @@
 #include <unistd.h>
 int main(){
     
-    ObjectWorldModel *om = om_new();
+    ObjectWorldModel *om = om_new_threaded();
 
     om_object_t new_obj;
     new_obj.utime = bot_timestamp_now();
@@ -28,15 +28,17 @@ int main(){
 
     fprintf(stderr, "Added object to server\n");
 
-    om_object_t *obj_by_id = NULL;
-
-    while (!obj_by_id){
-        sleep(1);
-        lcm_handle(om->lcm);
-        obj_by_id = om_get_object_by_id(om, 10);        
+    // the sync answer, or the next object list after our add, wakes us up
+    om_object_t *obj_by_id = om_wait_for_object(om, 10, 5000);
+    if (!obj_by_id) {
+        fprintf(stderr, "Server did not report the object\n");
+        om_destroy(om);
+        return 1;
     }
 
     fprintf(stderr, "Got object from server\n");
+    om_object_t_destroy(obj_by_id);
+    om_destroy(om);
     
     return 0;
 } 
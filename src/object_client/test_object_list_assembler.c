@@ -0,0 +1,115 @@
+/*
+ * Checks that om_list_assembler_t only hands out lists whose chunks cover
+ * every object exactly once: chunks arriving in any order and duplicated
+ * make the list, while overlapping chunks or chunks leaving a gap get the
+ * list dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "object_list_assembler.h"
+
+#define NUM_OBJECTS 10
+
+static om_object_t objects[NUM_OBJECTS];
+static int failed;
+
+static om_object_list_chunk_t chunk(int64_t utime, int index, int num_chunks,
+                                    int first, int num)
+{
+    om_object_list_chunk_t c =
+    {
+        .utime = utime,
+        .chunk_index = index,
+        .num_chunks = num_chunks,
+        .total_objects = NUM_OBJECTS,
+        .first_index = first,
+        .num_objects = num,
+        .objects = &objects[first]
+    };
+    return c;
+}
+
+// feeds the chunks in order, expecting a list only after the last one
+static void expect(const char *name, om_list_assembler_t *a,
+                   om_object_list_chunk_t *chunks, int n, int complete)
+{
+    om_object_list_t *list = NULL;
+    for (int i = 0; i < n; i++)
+    {
+        list = om_list_assembler_add(a, &chunks[i]);
+        if (list && i < n - 1)
+        {
+            fprintf(stderr, "%s: list complete after chunk %d of %d\n",
+                    name, i + 1, n);
+            failed = 1;
+        }
+    }
+
+    if (!list != !complete)
+    {
+        fprintf(stderr, "%s: list %s\n", name,
+                complete ? "never completed" : "completed anyway");
+        failed = 1;
+    }
+    if (list)
+    {
+        for (int i = 0; i < NUM_OBJECTS; i++)
+            if (list->objects[i].id != objects[i].id ||
+                !list->objects[i].label ||
+                strcmp(list->objects[i].label, objects[i].label))
+            {
+                fprintf(stderr, "%s: object %d garbled\n", name, i);
+                failed = 1;
+                break;
+            }
+        om_object_list_t_destroy(list);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        objects[i].id = i + 1;
+        objects[i].label = "object";
+    }
+
+    om_list_assembler_t *a = om_list_assembler_new();
+
+    om_object_list_chunk_t shuffled[] =
+        { chunk(1, 2, 3, 7, 3), chunk(1, 0, 3, 0, 4), chunk(1, 2, 3, 7, 3),
+          chunk(1, 1, 3, 4, 3) };
+    expect("shuffled", a, shuffled, 4, 1);
+
+    // late duplicates of a complete list make no second copy
+    om_object_list_chunk_t late[] = { chunk(1, 0, 3, 0, 4) };
+    expect("late duplicate", a, late, 1, 0);
+
+    om_object_list_chunk_t overlap[] =
+        { chunk(2, 0, 3, 0, 5), chunk(2, 1, 3, 4, 3), chunk(2, 2, 3, 7, 3) };
+    expect("overlap", a, overlap, 3, 0);
+
+    om_object_list_chunk_t gap[] =
+        { chunk(3, 0, 3, 0, 4), chunk(3, 1, 3, 5, 2), chunk(3, 2, 3, 7, 3) };
+    expect("gap", a, gap, 3, 0);
+
+    // an abandoned list doesn't hold up the next one
+    om_object_list_chunk_t next[] =
+        { chunk(4, 0, 2, 0, 5), chunk(4, 1, 2, 5, 5) };
+    expect("after abandoned", a, next, 2, 1);
+
+    int64_t dropped = om_list_assembler_get_dropped(a);
+    if (dropped != 2)
+    {
+        fprintf(stderr, "%"PRId64" lists dropped, want 2\n", dropped);
+        failed = 1;
+    }
+    om_list_assembler_destroy(a);
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
@@ -0,0 +1,124 @@
+/*
+ * Checks that om_list_buffer_t decodes object lists correctly and, once
+ * warmed up, without heap allocations. Linked with --wrap for the
+ * allocator functions, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object_list_buffer.h"
+
+#define NUM_OBJECTS 2000
+#define ROUNDS 100
+
+static long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) { allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { allocs++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t size) { allocs++; return __real_realloc(p, size); }
+
+static int lists_equal(const om_object_list_t *a, const om_object_list_t *b)
+{
+    if (a->utime != b->utime || a->num_objects != b->num_objects)
+        return 0;
+    for (int i = 0; i < a->num_objects; i++)
+    {
+        const om_object_t *x = &a->objects[i], *y = &b->objects[i];
+        if (x->utime != y->utime || x->id != y->id ||
+            memcmp(x->pos, y->pos, sizeof(x->pos)) ||
+            memcmp(x->orientation, y->orientation, sizeof(x->orientation)) ||
+            memcmp(x->bbox_min, y->bbox_min, sizeof(x->bbox_min)) ||
+            memcmp(x->bbox_max, y->bbox_max, sizeof(x->bbox_max)) ||
+            x->object_type != y->object_type || strcmp(x->label, y->label))
+            return 0;
+    }
+    return 1;
+}
+
+// moves every object a bit, and renames a few to labels no longer than
+// their old ones, the way the world changes between two lists
+static void step_world(om_object_list_t *list, int round)
+{
+    list->utime += 50000;
+    for (int i = 0; i < list->num_objects; i++)
+    {
+        list->objects[i].utime = list->utime;
+        list->objects[i].pos[0] += 0.01;
+        if ((i + round) % 97 == 0)
+            snprintf(list->objects[i].label, 8, "r%02d", round % 100);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    om_object_list_t list = { .utime = 1, .num_objects = NUM_OBJECTS };
+    list.objects = calloc(NUM_OBJECTS, sizeof(om_object_t));
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        list.objects[i].id = 1000 + i;
+        list.objects[i].pos[1] = i;
+        list.objects[i].orientation[0] = 1;
+        list.objects[i].object_type = i % 10;
+        list.objects[i].label = malloc(16);
+        snprintf(list.objects[i].label, 16, "object%d", i);
+    }
+
+    int size = om_object_list_t_encoded_size(&list);
+    void *data = malloc(size);
+
+    om_list_buffer_t *decoded = om_list_buffer_new();
+    om_list_buffer_t *copied = om_list_buffer_new();
+    int failed = 0;
+    long steady_allocs = 0;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        step_world(&list, round);
+        om_object_list_t_encode(data, 0, size, &list);
+
+        long before = allocs;
+        if (om_list_buffer_decode(decoded, data, size) < 0)
+        {
+            fprintf(stderr, "round %d: decode failed\n", round);
+            failed = 1;
+        }
+        om_list_buffer_copy(copied, &list);
+        if (round > 0)
+            steady_allocs += allocs - before;
+
+        if (!lists_equal(om_list_buffer_get_list(decoded), &list) ||
+            !lists_equal(om_list_buffer_get_list(copied), &list))
+        {
+            fprintf(stderr, "round %d: list differs from the original\n", round);
+            failed = 1;
+        }
+    }
+
+    // a truncated message must be refused
+    if (om_list_buffer_decode(decoded, data, size / 2) == 0 ||
+        om_list_buffer_get_list(decoded)->num_objects != 0)
+    {
+        fprintf(stderr, "truncated list was accepted\n");
+        failed = 1;
+    }
+
+    printf("%d rounds of %d objects, %ld allocations after the first round\n",
+           ROUNDS, NUM_OBJECTS, steady_allocs);
+    if (steady_allocs)
+        failed = 1;
+
+    om_list_buffer_destroy(decoded);
+    om_list_buffer_destroy(copied);
+    for (int i = 0; i < NUM_OBJECTS; i++)
+        free(list.objects[i].label);
+    free(list.objects);
+    free(data);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,144 @@
+/*
+ * Compiles object_model.hpp and runs its queries on a hand made snapshot:
+ * lookups by id, find_if(), count_if() and nearest_if(), and the ownership
+ * of Snapshot and WorldModel when moved around. Needs no server.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "object_model.hpp"
+
+using namespace object_model;
+
+#define NUM_OBJECTS 100
+
+static int failed;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    failed = 1; } } while (0)
+
+// objects along the x axis, id i+1 at x = i, every third one a chair
+static om_snapshot_t *make_snapshot(om_snapshot_pool_t *pool, int64_t version)
+{
+    static om_object_t objects[NUM_OBJECTS];
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        std::memset(&objects[i], 0, sizeof(om_object_t));
+        objects[i].id = i + 1;
+        objects[i].pos[0] = i;
+        objects[i].object_type = i % 3 ? OM_OBJECT_T_TABLE : OM_OBJECT_T_CHAIR;
+        objects[i].label = const_cast<char *>("object");
+    }
+    om_object_list_t list = { version, NUM_OBJECTS, objects };
+
+    om_snapshot_t *snap = om_snapshot_pool_get(pool);
+    om_list_buffer_copy(snap->buffer, &list);
+    om_object_index_build(snap->index, snap->ol->objects, snap->ol->num_objects);
+    snap->version = version;
+    return snap;
+}
+
+static bool is_chair(const Object &obj)
+{
+    return obj.object_type == OM_OBJECT_T_CHAIR;
+}
+
+static void test_queries(om_snapshot_pool_t *pool)
+{
+    Snapshot snap(make_snapshot(pool, 7));
+    CHECK(snap);
+    CHECK(snap.version() == 7 && snap.utime() == 7);
+    CHECK(snap.objects().size() == NUM_OBJECTS);
+
+    ObjectRef obj = snap.find(42);
+    CHECK(obj && obj->id == 42 && obj->pos[0] == 41);
+    CHECK(!snap.find(NUM_OBJECTS + 1));
+    bool threw = false;
+    try { snap.find(0).value(); }
+    catch (const std::out_of_range &) { threw = true; }
+    CHECK(threw);
+
+    // lambdas and plain functions both do as filters
+    ObjectRef first = snap.find_if([](const Object &o) { return o.pos[0] > 10.5; });
+    CHECK(first && first->id == 12);
+    CHECK(!snap.find_if([](const Object &o) { return o.id < 0; }));
+    CHECK(snap.count_if(is_chair) == (NUM_OBJECTS + 2) / 3);
+
+    // around x = 13.8 the chairs are at 12 and 15, a table is at 14
+    double dist = -1;
+    ObjectRef chair = snap.nearest_if(13.8, 0, 0, 5.0, is_chair, &dist);
+    CHECK(chair && chair->id == 16 && std::fabs(dist - 1.2) < 1e-9);
+    ObjectRef any = snap.nearest_if(13.8, 0, 0, 5.0,
+                                    [](const Object &) { return true; });
+    CHECK(any && any->id == 15);
+    dist = -1;
+    CHECK(!snap.nearest_if(13.8, 3.0, 0, 1.0, is_chair, &dist) && dist == -1);
+
+    int in_radius = 0;
+    snap.for_each_in_radius(50, 0, 0, 1.5, is_chair,
+                            [&](const Object &) { in_radius++; });
+    CHECK(in_radius == 1);  // chairs at 48 and 51, only 51 is that close
+
+    Snapshot none;
+    CHECK(!none && none.objects().empty() && !none.find(1) && none.version() == 0);
+}
+
+static void test_snapshot_moves(om_snapshot_pool_t *pool)
+{
+    om_snapshot_t *a = make_snapshot(pool, 1);
+    om_snapshot_t *b = make_snapshot(pool, 2);
+    // keep a reference of our own to watch the wrappers release theirs
+    g_atomic_int_inc(&a->refcount);
+    g_atomic_int_inc(&b->refcount);
+
+    {
+        Snapshot sa(a);
+        Snapshot moved(std::move(sa));
+        CHECK(!sa && moved.get() == a && moved.version() == 1);
+        CHECK(g_atomic_int_get(&a->refcount) == 2);
+
+        Snapshot sb(b);
+        moved = std::move(sb);
+        CHECK(!sb && moved.get() == b);
+        // assigning over it released a
+        CHECK(g_atomic_int_get(&a->refcount) == 1);
+        CHECK(g_atomic_int_get(&b->refcount) == 2);
+
+        Snapshot &self = moved;
+        moved = std::move(self);
+        CHECK(moved.get() == b && g_atomic_int_get(&b->refcount) == 2);
+    }
+    CHECK(g_atomic_int_get(&b->refcount) == 1);
+
+    om_snapshot_unref(a);
+    om_snapshot_unref(b);
+}
+
+static void test_world_model_moves()
+{
+    // no server here, so only ownership is checked; om_destroy() takes NULL
+    WorldModel world(nullptr);
+    WorldModel moved(std::move(world));
+    CHECK(!world.get() && !moved.get());
+
+    WorldModel other(nullptr);
+    other = std::move(moved);
+    CHECK(!other.get() && !moved.get());
+}
+
+int main(int argc, char **argv)
+{
+    om_snapshot_pool_t *pool = om_snapshot_pool_new();
+    test_queries(pool);
+    test_snapshot_moves(pool);
+    test_world_model_moves();
+    om_snapshot_pool_close(pool);
+
+    std::printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
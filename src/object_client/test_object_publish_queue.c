@@ -0,0 +1,141 @@
+/*
+ * Stress test of om_publish_queue_t: several threads push numbered updates
+ * into a small queue while several others pop them, with either policy.
+ * Checks that every update comes out at most once, that none is lost
+ * unless counted as dropped, and that every popper sees the updates of a
+ * pusher in the order they were pushed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "object_publish_queue.h"
+
+#define NUM_PUSHERS 4
+#define NUM_POPPERS 2
+#define NUM_UPDATES 200000      // per pusher
+#define CAPACITY 64
+
+static om_publish_queue_t *queue;
+static volatile int done;
+static unsigned char seen[NUM_PUSHERS][NUM_UPDATES];
+static int failed;
+
+// updates are numbered by utime, id tells the pushers apart
+static void *push_thread(void *user)
+{
+    long pusher = (long)user;
+    for (long i = 0; i < NUM_UPDATES; i++)
+    {
+        om_object_t obj = { .utime = i, .id = pusher, .label = "update" };
+        om_publish_queue_push(queue, &obj);
+    }
+    return NULL;
+}
+
+static void *pop_thread(void *user)
+{
+    long *popped = (long*)user;
+    int64_t last[NUM_PUSHERS];
+    for (int i = 0; i < NUM_PUSHERS; i++)
+        last[i] = -1;
+
+    for (;;)
+    {
+        om_publish_queue_wait(queue);
+        int quit = __sync_fetch_and_add(&done, 0);
+
+        om_object_t obj;
+        while (om_publish_queue_pop(queue, &obj))
+        {
+            if (obj.id < 0 || obj.id >= NUM_PUSHERS || obj.utime < 0 ||
+                obj.utime >= NUM_UPDATES || strcmp(obj.label, "update"))
+            {
+                fprintf(stderr, "garbled update %"PRId64"/%"PRId64"\n",
+                        obj.id, obj.utime);
+                failed = 1;
+            }
+            else
+            {
+                if (__sync_fetch_and_add(&seen[obj.id][obj.utime], 1))
+                {
+                    fprintf(stderr, "update %"PRId64"/%"PRId64" popped twice\n",
+                            obj.id, obj.utime);
+                    failed = 1;
+                }
+                if (obj.utime <= last[obj.id])
+                {
+                    fprintf(stderr, "update %"PRId64"/%"PRId64" after %"PRId64"\n",
+                            obj.id, obj.utime, last[obj.id]);
+                    failed = 1;
+                }
+                last[obj.id] = obj.utime;
+            }
+            free(obj.label);
+            (*popped)++;
+        }
+        if (quit)
+            break;
+    }
+    return NULL;
+}
+
+static int run(om_queue_policy_t policy, const char *name)
+{
+    queue = om_publish_queue_new(CAPACITY, policy);
+    memset(seen, 0, sizeof(seen));
+    done = 0;
+    failed = 0;
+
+    pthread_t pushers[NUM_PUSHERS], poppers[NUM_POPPERS];
+    long popped[NUM_POPPERS] = { 0 };
+    for (long i = 0; i < NUM_POPPERS; i++)
+        pthread_create(&poppers[i], NULL, pop_thread, &popped[i]);
+    for (long i = 0; i < NUM_PUSHERS; i++)
+        pthread_create(&pushers[i], NULL, push_thread, (void*)i);
+
+    for (int i = 0; i < NUM_PUSHERS; i++)
+        pthread_join(pushers[i], NULL);
+    __sync_fetch_and_add(&done, 1);
+    for (int i = 0; i < NUM_POPPERS; i++)
+        om_publish_queue_wake(queue);
+    for (int i = 0; i < NUM_POPPERS; i++)
+        pthread_join(poppers[i], NULL);
+
+    long total = 0, missing = 0;
+    for (int i = 0; i < NUM_POPPERS; i++)
+        total += popped[i];
+    for (int p = 0; p < NUM_PUSHERS; p++)
+        for (int i = 0; i < NUM_UPDATES; i++)
+            missing += !seen[p][i];
+    int64_t dropped = om_publish_queue_get_dropped(queue);
+
+    // only dropping may lose updates, and exactly the ones it counted
+    if (missing != dropped || (policy == OM_QUEUE_BLOCK && dropped))
+    {
+        fprintf(stderr, "%ld updates missing, %"PRId64" dropped\n",
+                missing, dropped);
+        failed = 1;
+    }
+    if (total + dropped != (long)NUM_PUSHERS * NUM_UPDATES)
+    {
+        fprintf(stderr, "%ld popped and %"PRId64" dropped of %ld\n",
+                total, dropped, (long)NUM_PUSHERS * NUM_UPDATES);
+        failed = 1;
+    }
+
+    om_publish_queue_destroy(queue);
+    printf("%s: %s, %ld popped, %"PRId64" dropped\n", name,
+           failed ? "FAILED" : "OK", total, dropped);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int rc = run(OM_QUEUE_BLOCK, "block");
+    rc |= run(OM_QUEUE_DROP_OLDEST, "drop oldest");
+    return rc;
+}
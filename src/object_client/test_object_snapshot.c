@@ -0,0 +1,122 @@
+/*
+ * Stress test of snapshot publication: a writer publishes list after list
+ * while readers acquire the current snapshot in a loop. Every list stamps
+ * all its objects with its number, so a reader that got a snapshot which
+ * was recycled under it sees the stamps or the version change while it
+ * holds it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "object_snapshot.h"
+
+#define NUM_READERS 4
+#define NUM_LISTS 200000
+#define NUM_OBJECTS 16
+
+static om_snapshot_pool_t *pool;
+static om_snapshot_slot_t slot;
+static volatile int done;
+static volatile int failed;
+
+static void *write_thread(void *user)
+{
+    om_object_t objects[NUM_OBJECTS];
+    memset(objects, 0, sizeof(objects));
+    om_object_list_t list = { .num_objects = NUM_OBJECTS, .objects = objects };
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        objects[i].id = i + 1;
+        objects[i].label = "object";
+    }
+
+    for (int64_t gen = 1; gen <= NUM_LISTS; gen++)
+    {
+        list.utime = gen;
+        for (int i = 0; i < NUM_OBJECTS; i++)
+            objects[i].utime = gen;
+        om_snapshot_t *snap = om_snapshot_pool_get(pool);
+        om_list_buffer_copy(snap->buffer, &list);
+        om_object_index_build(snap->index, snap->ol->objects, snap->ol->num_objects);
+        snap->version = gen;
+        om_snapshot_slot_publish(&slot, snap);
+        // let the readers in between lists even on a single core
+        if (gen % 4 == 0)
+            sched_yield();
+    }
+    __sync_fetch_and_add(&done, 1);
+    return NULL;
+}
+
+static int check(const om_snapshot_t *snap, int64_t gen)
+{
+    if (snap->version != gen || snap->ol->utime != gen ||
+        snap->ol->num_objects != NUM_OBJECTS)
+        return 0;
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        const om_object_t *obj = &snap->ol->objects[i];
+        if (obj->utime != gen || om_object_index_lookup(snap->index, obj->id) != i)
+            return 0;
+    }
+    return 1;
+}
+
+static void *read_thread(void *user)
+{
+    long *acquired = (long*)user;
+    int64_t last = 0;
+    while (!__sync_fetch_and_add(&done, 0))
+    {
+        om_snapshot_t *snap = om_snapshot_slot_acquire(&slot);
+        if (!snap)
+            continue;
+        int64_t gen = snap->version;
+        int ok = gen >= last && check(snap, gen);
+        // hold on to it while the writer moves on
+        for (int i = 0; i < 3 && ok; i++)
+        {
+            sched_yield();
+            ok = check(snap, gen);
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "snapshot of list %"PRId64" changed under us\n", gen);
+            failed = 1;
+        }
+        last = gen;
+        om_snapshot_unref(snap);
+        (*acquired)++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    pool = om_snapshot_pool_new();
+
+    pthread_t writer, readers[NUM_READERS];
+    long acquired[NUM_READERS] = { 0 };
+    for (long i = 0; i < NUM_READERS; i++)
+        pthread_create(&readers[i], NULL, read_thread, &acquired[i]);
+    pthread_create(&writer, NULL, write_thread, NULL);
+
+    pthread_join(writer, NULL);
+    long total = 0;
+    for (int i = 0; i < NUM_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        total += acquired[i];
+    }
+
+    om_snapshot_slot_clear(&slot);
+    om_snapshot_pool_close(pool);
+    printf("%s, %d lists, %ld acquired\n", failed ? "FAILED" : "OK",
+           NUM_LISTS, total);
+    return failed;
+}
@@ -20,6 +20,10 @@
 #include <lcmtypes/om_object_t.h>
 #include <lcmtypes/om_xml_cmd_t.h>
 
+#include <object_model/object_list_assembler.h>
+#include <object_model/object_list_buffer.h>
+#include <object_model/object_bvh.h>
+
 #define RENDERER_NAME "Object Model"
 #define PARAM_TRIADS "Draw Triads"
 #define PARAM_BBOX "Draw Bounding Boxes"
@@ -86,7 +90,9 @@ typedef struct _renderer_object_model_t {
     BotViewer   *viewer;
     BotParam * param;
     lcm_t    *lcm;
-    om_object_list_t_subscription_t *object_lcm_hid;
+    lcm_subscription_t *object_lcm_hid;
+    om_object_list_chunk_t_subscription_t *object_chunk_lcm_hid;
+    om_list_assembler_t *assembler;
 
     BotGtkParamWidget *pw;
     gboolean draw_unit_triads;
@@ -95,7 +101,11 @@ typedef struct _renderer_object_model_t {
 
     GMutex *mutex; /* protect self */
 
-    om_object_list_t *object_list;
+    om_object_list_t *object_list; /* the list in the front buffer */
+    om_list_buffer_t *object_buffers[2]; /* drawn from, received into */
+    int front_buffer;
+    om_bvh_t *bvh; /* boxes of object_list, ids are indices into it */
+    gboolean bvh_dirty;
     
     int num_of_models;
     GHashTable *model_hash;
@@ -617,17 +627,25 @@ draw_object(renderer_om_object_t *self, const om_object_t *object)
     g_string_free(config_prefix, TRUE);
 }
 
+/* the lcm handlers fill the back buffer, which only they touch, and then
+ * swap it to the front. both buffers keep their memory, so receiving a
+ * list normally allocates nothing. */
 static void
-on_object_list(const lcm_recv_buf_t *rbuf, const char *channel,
-               const om_object_list_t *msg, void *user)
+swap_object_buffers(renderer_om_object_t *self)
 {
-    renderer_om_object_t *self = (renderer_om_object_t*)user;
+    om_object_list_t *list =
+        om_list_buffer_get_list(self->object_buffers[!self->front_buffer]);
 
-    /* copy lcm message data to local buffer and let draw update the display */
+    /* swap in the new list and let draw update the display */
     g_mutex_lock(self->mutex);
-    if (self->object_list)
-        om_object_list_t_destroy(self->object_list);
-    self->object_list = om_object_list_t_copy(msg);
+    if (self->object_list && list->utime < self->object_list->utime) {
+        /* older than what we are drawing already */
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+    self->front_buffer = !self->front_buffer;
+    self->object_list = list;
+    self->bvh_dirty = TRUE;
     BotViewer *viewer = self->viewer; /* copy viewer to stack in case self is 
                                     * free'd between the unlock and call to 
                                     * viewer_request_redraw */
@@ -641,6 +659,34 @@ on_object_list(const lcm_recv_buf_t *rbuf, const char *channel,
         bot_viewer_request_redraw(viewer);
 }
 
+static void
+on_object_list(const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    renderer_om_object_t *self = (renderer_om_object_t*)user;
+    om_list_buffer_t *back = self->object_buffers[!self->front_buffer];
+
+    if (om_list_buffer_decode(back, rbuf->data, rbuf->data_size) < 0) {
+        ERR("Error: could not decode message on %s\n", channel);
+        return;
+    }
+    swap_object_buffers(self);
+}
+
+static void
+on_object_list_chunk(const lcm_recv_buf_t *rbuf, const char *channel,
+                     const om_object_list_chunk_t *msg, void *user)
+{
+    renderer_om_object_t *self = (renderer_om_object_t*)user;
+
+    /* only this lcm handler touches the assembler */
+    om_object_list_t *list = om_list_assembler_add(self->assembler, msg);
+    if (list) {
+        om_list_buffer_copy(self->object_buffers[!self->front_buffer], list);
+        om_object_list_t_destroy(list);
+        swap_object_buffers(self);
+    }
+}
+
 char *
 objects_snapshot (renderer_om_object_t *self)
 {
@@ -836,13 +882,17 @@ renderer_om_object_destroy(BotRenderer *renderer)
     /* stop listening to lcm */
     if (self->lcm) {
         if (self->object_lcm_hid)
-            om_object_list_t_unsubscribe(self->lcm, 
-                                            self->object_lcm_hid);
+            lcm_unsubscribe(self->lcm, self->object_lcm_hid);
+        if (self->object_chunk_lcm_hid)
+            om_object_list_chunk_t_unsubscribe(self->lcm,
+                                               self->object_chunk_lcm_hid);
     }
+    om_list_assembler_destroy(self->assembler);
     
     /* destory local copy of lcm data objects */
-    if (self->object_list)
-        om_object_list_t_destroy(self->object_list);
+    om_list_buffer_destroy(self->object_buffers[0]);
+    om_list_buffer_destroy(self->object_buffers[1]);
+    om_bvh_destroy(self->bvh);
     
     if (self->last_save_filename)
         g_free (self->last_save_filename);
@@ -888,25 +938,29 @@ on_save_preferences(BotViewer *viewer, GKeyFile *keyfile, void *user)
 }
 
 
+/* returns the first object the ray hits, and its distance along the ray.
+ * the mutex must be held. */
 static om_object_t * 
-find_closest_object(renderer_om_object_t *self, const double pos[3])
-
+pick_object(renderer_om_object_t *self, const double ray_start[3],
+            const double ray_dir[3], double *dist)
 {
-    double closest_dist=HUGE;
-    om_object_t *closest_object=NULL;
-    /* iterate through object list to find closest object to pos */
-    if (self->object_list && self->object_list->num_objects) {
-        for (int i = 0; i < self->object_list->num_objects; i++) {
-            om_object_t *p = self->object_list->objects + i;  
-            double dist = sqrt(bot_sq(p->pos[0] - pos[0]) + bot_sq(p->pos[1] - pos[1]));        
-            if (closest_dist>dist) {
-                closest_dist=dist;
-                closest_object=p;
-            }
+    if (!self->object_list)
+        return NULL;
+
+    if (self->bvh_dirty) {
+        int n = self->object_list->num_objects;
+        om_bvh_box_t *boxes = malloc((n+1) * sizeof(om_bvh_box_t));
+        for (int i = 0; i < n; i++) {
+            om_object_t *p = self->object_list->objects + i;
+            om_bvh_box_set(&boxes[i], p->pos, p->orientation,
+                           p->bbox_min, p->bbox_max, i);
         }
-        
+        om_bvh_build(self->bvh, boxes, n);
+        self->bvh_dirty = FALSE;
     }
-    return closest_object;
+
+    int64_t idx = om_bvh_raycast(self->bvh, ray_start, ray_dir, HUGE, dist);
+    return idx >= 0 ? self->object_list->objects + idx : NULL;
 }
 
 
@@ -917,23 +971,15 @@ static double pick_query(BotViewer *viewer, BotEventHandler *ehandler,
     if (!self->teleport_request)
        return -1;
 
-    double pos[3]={0,0,0};
-    geom_ray_z_plane_intersect_3d(POINT3D(ray_start), 
-            POINT3D(ray_dir), 0, POINT2D(pos));
-
     g_mutex_lock(self->mutex);
 
     double closest_dist =HUGE;
-    om_object_t *closest_object = find_closest_object(self,pos);
-    if (closest_object) {
-        double dist = sqrt(bot_sq(closest_object->pos[0] - pos[0]) + bot_sq(closest_object->pos[1] - pos[1]));
-        if (dist<closest_dist) {
-            self->hover_id = closest_object->id;
-            closest_dist=dist;
-        }
-    }
+    om_object_t *closest_object = pick_object(self, ray_start, ray_dir,
+                                              &closest_dist);
+    if (closest_object)
+        self->hover_id = closest_object->id;
     g_mutex_unlock(self->mutex);
-    if (closest_dist !=HUGE) 
+    if (closest_object) 
         return closest_dist;
 
     self->ehandler.hovering = 0;
@@ -951,17 +997,11 @@ static int mouse_press (BotViewer *viewer, BotEventHandler *ehandler,
     // only handle mouse button 1.
     if (self->teleport_request && (event->button == 1)) {   
         // find teleport object
-        double pos[3]={0,0,0};
-        geom_ray_z_plane_intersect_3d(POINT3D(ray_start), 
-                                      POINT3D(ray_dir), 0, POINT2D(pos));
-
         g_mutex_lock(self->mutex);
         double closest_object_dist =HUGE;
  
-        om_object_t *closest_object = find_closest_object(self,pos);
-        if (closest_object) {
-            closest_object_dist = sqrt(bot_sq(closest_object->pos[0] - pos[0]) + bot_sq(closest_object->pos[1] - pos[1]));
-        }
+        om_object_t *closest_object = pick_object(self, ray_start, ray_dir,
+                                                  &closest_object_dist);
         if (closest_object) {
             self->hover_id = closest_object->id;
             if (self->teleport_object)
@@ -1132,7 +1172,10 @@ renderer_om_object_new(BotViewer *viewer, BotParam * param)
 
     /* listen to object list */
 
-    self->object_lcm_hid = om_object_list_t_subscribe(self->lcm, 
+    self->object_buffers[0] = om_list_buffer_new();
+    self->object_buffers[1] = om_list_buffer_new();
+    self->bvh = om_bvh_new();
+    self->object_lcm_hid = lcm_subscribe(self->lcm, 
         "OBJECT_LIST", on_object_list, self);
     if (!self->object_lcm_hid) {
         ERR("Error: renderer_om_object_new() failed to subscribe to the "
@@ -1140,6 +1183,16 @@ renderer_om_object_new(BotViewer *viewer, BotParam * param)
         goto fail;
     }
 
+    /* large worlds arrive in chunks */
+    self->assembler = om_list_assembler_new();
+    self->object_chunk_lcm_hid = om_object_list_chunk_t_subscribe(self->lcm,
+        "OBJECT_LIST_CHUNK", on_object_list_chunk, self);
+    if (!self->object_chunk_lcm_hid) {
+        ERR("Error: renderer_om_object_new() failed to subscribe to the "
+            "'OBJECT_LIST_CHUNK' LCM channel\n");
+        goto fail;
+    }
+
     /* renderer options defaults */
     self->draw_unit_triads = DRAW_UNIT_TRIADS_DEFAULT;
     self->draw_bbox = DRAW_BBOX_DEFAULT;
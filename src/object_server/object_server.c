@@ -12,6 +12,22 @@
 
 #include <lcmtypes/om_object_list_t.h>
 #include <lcmtypes/om_object_t.h>
+#include <lcmtypes/om_object_patch_t.h>
+#include <lcmtypes/om_object_list_chunk_t.h>
+#include <lcmtypes/om_object_list_sync_t.h>
+#include <lcmtypes/om_sync_request_t.h>
+#include <lcmtypes/om_replica_delta_t.h>
+#include <lcmtypes/om_replica_heartbeat_t.h>
+#include <lcmtypes/om_replica_sync_request_t.h>
+#include <lcmtypes/om_id_block_request_t.h>
+#include <lcmtypes/om_id_block_t.h>
+#include <lcmtypes/om_region_t.h>
+#include <lcmtypes/om_region_event_t.h>
+
+#include "obstacle_grid.h"
+#include "object_shm_writer.h"
+#include "region_monitor.h"
+#include "object_ids.h"
 
 #if 1
 #define ERR(...) do { fprintf(stderr, "[%s:%d] ", __FILE__, __LINE__); \
@@ -29,21 +45,105 @@
 
 #define OBJECTS_PUBLISH_HZ 20
 
+// lists that encode larger than this go out in pieces on OBJECT_LIST_CHUNK,
+// small enough for a single UDP datagram
+#define OBJECT_LIST_CHUNK_CHANNEL "OBJECT_LIST_CHUNK"
+#define CHUNK_BYTES_DEFAULT 60000
+
+// must not match OBJECTS_UPDATE.*, which carries whole objects
+#define PATCH_CHANNEL "OBJECTS_PATCH"
+
+#define SYNC_REQUEST_CHANNEL "OBJECT_LIST_SYNC_REQUEST"
+#define SYNC_CHANNEL         "OBJECT_LIST_SYNC"
+#define SYNC_CHUNK_CHANNEL   "OBJECT_LIST_SYNC_CHUNK"
+
+#define OBSTACLE_GRID_CHANNEL "OBSTACLE_GRID"
+#define GRID_RESOLUTION_DEFAULT 0.1
+#define GRID_TILE_SIZE 32
+// publish every occupied tile once a second, only changed tiles otherwise
+#define GRID_KEYFRAME_INTERVAL OBJECTS_PUBLISH_HZ
+
+// regions to watch, and what objects did in them
+#define REGION_CHANNEL       "OBJECT_REGIONS"
+#define REGION_EVENT_CHANNEL "OBJECT_REGION_EVENTS"
+#define REGION_BUCKET_SIZE 5.0
+
+#define REPLICA_DELTA_CHANNEL     "OBJECT_SERVER_REPLICA_DELTA"
+#define REPLICA_HEARTBEAT_CHANNEL "OBJECT_SERVER_REPLICA_HEARTBEAT"
+#define REPLICA_SYNC_CHANNEL      "OBJECT_SERVER_REPLICA_SYNC"
+// a stepping-down primary hands its objects to the new one on this channel
+#define REPLICA_HANDOFF_CHANNEL   "OBJECTS_UPDATE_REPLICA"
+#define HEARTBEAT_HZ 5
+#define PRIMARY_TIMEOUT_USEC 1000000
+#define SYNC_RETRY_USEC 500000
+// a new primary skips this many ids, which the old one may have handed out
+// after its last heartbeat
+#define ID_BLOCK_FAILOVER_GAP ((int64_t)1 << 28)
+
 #define LOCAL_FRAME_ID 0
 #define FORKLIFT_OBJECT_ID 1             
 #define GLOBAL_FRAME_ID 2             
 
+typedef enum {
+    ROLE_PRIMARY,
+    ROLE_BACKUP
+} server_role_t;
+
+// An object in the store, along with the store version at which it last
+// changed. The object is kept in the world frame, exactly as published.
+//
+// An attached object (pallet on a truck, item on the tines) follows its
+// parent: its pose relative to the parent is what counts, and its world
+// pose is only a cache, recomputed when read after the parent moved.
+typedef struct _object_entry_t {
+    om_object_t object;
+    int64_t version;
+
+    struct _object_entry_t *parent; // NULL unless attached
+    GSList *children;               // entries attached to this one
+    double rel_pos[3];              // pose in the parent's frame
+    double rel_orientation[4];
+    gboolean world_dirty;           // object pose older than the parent's
+} object_entry_t;
+
 typedef struct _dynamic_objects_t {
     lcm_t     *lcm;
     GMainLoop *main_loop;
     guint      timer_id;
 
-    GHashTable *objects;
+    GHashTable *objects;        // id -> object_entry_t
     om_object_list_t object_list;
     GMutex *mutex;
+    int chunk_bytes;            // 0 to never split the object list
+
+    int64_t version;            // bumped on every change to the store
+    int64_t epoch;              // new whenever versions stop comparing
+
+    /* replication */
+    int64_t server_id;
+    server_role_t role;
+    GHashTable *changed;        // entries changed since the last replica delta
+    int64_t replicated_version; // version covered by the last replica delta
+    int64_t last_primary_utime; // when we last heard from the primary
+    int64_t last_sync_request_utime;
+    int64_t tick;
+    int64_t next_id_block;      // first id of the next block to hand out
 
     gboolean use_global_pose;
 
+    gboolean publish_rects;
+    double grid_resolution;
+    obstacle_grid_t *grid;
+    GHashTable *grid_dirty;     // entries whose footprint may have changed
+    int64_t grid_publish_count;
+
+    region_monitor_t *regions;
+    GHashTable *region_dirty;   // entries moved since the last tick
+
+    char *shm_name;             // publish into shared memory if set
+    object_shm_writer_t *shm;
+    int64_t shm_version;        // store version last written to shm
+
     int verbose;
 
     int simulation;
@@ -57,8 +157,16 @@ _g_int64_t_equal (gconstpointer v1,gconstpointer v2) {
 
 static guint
 _g_int64_t_hash (gconstpointer v) {
-    // use bottom 4 bytes (should be most unique)
-    return 0x00ffffffff&(*(int64_t *)v);
+    // the low half of client made ids is a per-process counter, so ids of
+    // different clients only differ above it; mix all bits into the low ones
+    // (same mixer as object_index.c)
+    uint64_t h = *(const uint64_t *)v;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (guint)h;
 }
 
 
@@ -92,41 +200,540 @@ my_transform_rev(double pos1[3], double quat1[4],
 }
 
 
+static object_entry_t *
+object_entry_new(const om_object_t *object)
+{
+    object_entry_t *entry = calloc(1, sizeof(object_entry_t));
+    memcpy(&entry->object, object, sizeof(om_object_t));
+    entry->object.label = strdup(object->label ? object->label : "");
+    return entry;
+}
+
+static void
+object_entry_set(object_entry_t *entry, const om_object_t *object)
+{
+    // the label belongs to the incoming message, keep our own copy
+    char *label = entry->object.label;
+    memcpy(&entry->object, object, sizeof(om_object_t));
+    entry->object.label = strdup(object->label ? object->label : "");
+    free(label);
+}
+
+static void
+object_entry_destroy(object_entry_t *entry)
+{
+    free(entry->object.label);
+    g_slist_free(entry->children);
+    free(entry);
+}
+
+/*
+ * Returns the object with its world pose up to date. Every read of an
+ * object's pose has to go through here.
+ */
+static om_object_t *
+object_entry_world(object_entry_t *entry)
+{
+    if (entry->world_dirty) {
+        om_object_t *parent = object_entry_world(entry->parent);
+        my_transform(entry->object.pos, entry->object.orientation,
+                     parent->pos, parent->orientation,
+                     entry->rel_pos, entry->rel_orientation);
+        entry->world_dirty = FALSE;
+    }
+    return &entry->object;
+}
+
+// Marks the world poses below entry as out of date. Below a dirty entry
+// everything is dirty already.
+static void
+object_entry_children_moved(object_entry_t *entry)
+{
+    for (GSList *iter = entry->children; iter; iter = iter->next) {
+        object_entry_t *child = iter->data;
+        if (!child->world_dirty) {
+            child->world_dirty = TRUE;
+            object_entry_children_moved(child);
+        }
+    }
+}
+
+/*
+ * Call after the world pose of entry was set from outside: an attached
+ * entry stays attached where it now is, and what is attached to it
+ * follows.
+ */
+static void
+object_entry_pose_set(object_entry_t *entry)
+{
+    entry->world_dirty = FALSE;
+    if (entry->parent) {
+        // the inverse of my_transform(), which object_entry_world() applies
+        om_object_t *parent = object_entry_world(entry->parent);
+        double parent_inv[4] = { parent->orientation[0], -parent->orientation[1],
+                                 -parent->orientation[2], -parent->orientation[3] };
+        for (int i = 0; i < 3; i++)
+            entry->rel_pos[i] = entry->object.pos[i] - parent->pos[i];
+        bot_quat_rotate_rev(parent->orientation, entry->rel_pos);
+        bot_quat_mult(entry->rel_orientation, parent_inv, entry->object.orientation);
+    }
+    object_entry_children_moved(entry);
+}
+
+/*
+ * Records that entry changed at the given store version. Every change to
+ * the store has to go through here so that it reaches the replicas and
+ * the obstacle grid.
+ */
+static void
+dynamic_objects_object_changed(dynamic_objects_t *self, object_entry_t *entry,
+                               int64_t version)
+{
+    entry->version = version;
+    if (version > self->version)
+        self->version = version;
+
+    if (self->role == ROLE_PRIMARY)
+        g_hash_table_insert(self->changed, &entry->object.id, entry);
+    // attached objects ride on something else and are no obstacles
+    if (self->grid_dirty && !entry->parent)
+        g_hash_table_insert(self->grid_dirty, &entry->object.id, &entry->object);
+    g_hash_table_insert(self->region_dirty, &entry->object.id, entry);
+}
+
+/*
+ * Attaches entry to the object parent_id, or detaches it for 0, keeping
+ * its world pose. Fails for unknown parents and for attaching an object
+ * to something attached to it.
+ */
+static gboolean
+dynamic_objects_attach(dynamic_objects_t *self, object_entry_t *entry,
+                       int64_t parent_id)
+{
+    object_entry_t *parent = NULL;
+    if (parent_id) {
+        parent = g_hash_table_lookup(self->objects, &parent_id);
+        if (!parent)
+            return FALSE;
+        for (object_entry_t *p = parent; p; p = p->parent)
+            if (p == entry)
+                return FALSE;
+    }
+    if (parent == entry->parent)
+        return TRUE;
+
+    object_entry_world(entry);
+    if (entry->parent)
+        entry->parent->children = g_slist_remove(entry->parent->children, entry);
+    entry->parent = parent;
+    if (parent)
+        parent->children = g_slist_prepend(parent->children, entry);
+
+    if (self->grid && parent) {
+        g_hash_table_remove(self->grid_dirty, &entry->object.id);
+        obstacle_grid_remove_object(self->grid, entry->object.id);
+    }
+    object_entry_pose_set(entry);
+    return TRUE;
+}
+
 static void
 on_objects_update(const lcm_recv_buf_t *rbuf, const char *channel,
                const om_object_list_t *msg, void *user)
 {
     dynamic_objects_t *self = (dynamic_objects_t*)user;
     g_mutex_lock(self->mutex);
+
+    // standbys only follow the primary's change stream
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
     for (int i = 0; i < msg->num_objects; i++) {
         om_object_t *object = &msg->objects[i]; 
-        om_object_t *my_object = g_hash_table_lookup(self->objects, &object->id);
+        object_entry_t *entry = g_hash_table_lookup(self->objects, &object->id);
 
         if (self->verbose)
             fprintf (stdout,"Got request to update object with id = %"PRId64" : \n", object->id);
 
-        if (!my_object) {
+        if (!entry) {
             // add object to hash table.
-            my_object = om_object_t_copy(object);
-            g_hash_table_insert(self->objects, &my_object->id, my_object);                        
+            entry = object_entry_new(object);
+            g_hash_table_insert(self->objects, &entry->object.id, entry);
+            dynamic_objects_object_changed(self, entry, self->version + 1);
             if (self->verbose)
-                fprintf (stdout,"... Doesn't exist, adding object with id = %"PRId64" \n", my_object->id);
+                fprintf (stdout,"... Doesn't exist, adding object with id = %"PRId64" \n", object->id);
         }
         else {
             // update object if the update time is newer than the last access
-            if (my_object->utime < object->utime) {
-                memcpy(my_object,object,sizeof(om_object_t));
+            if (entry->object.utime < object->utime) {
+                object_entry_set(entry, object);
+                object_entry_pose_set(entry);
+                dynamic_objects_object_changed(self, entry, self->version + 1);
                 
                 if (self->verbose)
-                    fprintf (stdout, "... Exists, updating object id = %"PRId64" \n", my_object->id);
+                    fprintf (stdout, "... Exists, updating object id = %"PRId64" \n", object->id);
             }
             else if (self->verbose)
-                fprintf (stdout, "... Exists but utime is old. Ignoring update for object id = %"PRId64" \n", my_object->id);
+                fprintf (stdout, "... Exists but utime is old. Ignoring update for object id = %"PRId64" \n", object->id);
         }
     }
     g_mutex_unlock(self->mutex);
 }
 
+/*
+ * Patches are applied in the order they arrive, whatever their utime: two
+ * relative moves both count even if they were made at the same time.
+ */
+static void
+on_object_patch(const lcm_recv_buf_t *rbuf, const char *channel,
+                const om_object_patch_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    g_mutex_lock(self->mutex);
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    object_entry_t *entry = g_hash_table_lookup(self->objects, &msg->id);
+    if (!entry) {
+        if (self->verbose)
+            fprintf (stdout, "Ignoring patch for unknown object id = %"PRId64"\n", msg->id);
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    if ((msg->fields & OM_OBJECT_PATCH_T_PARENT) &&
+        !dynamic_objects_attach(self, entry, msg->parent_id)) {
+        ERR("Error: can't attach object %"PRId64" to %"PRId64"\n",
+            msg->id, msg->parent_id);
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    om_object_t *object = object_entry_world(entry);
+    if (msg->fields & OM_OBJECT_PATCH_T_POS_DELTA) {
+        for (int i = 0; i < 3; i++)
+            object->pos[i] += msg->pos[i];
+    }
+    else if (msg->fields & OM_OBJECT_PATCH_T_POS)
+        memcpy(object->pos, msg->pos, sizeof(object->pos));
+
+    if (msg->fields & OM_OBJECT_PATCH_T_ORIENTATION_DELTA) {
+        double q[4];
+        bot_quat_mult(q, msg->orientation, object->orientation);
+        bot_quat_normalize(q);
+        memcpy(object->orientation, q, sizeof(q));
+    }
+    else if (msg->fields & OM_OBJECT_PATCH_T_ORIENTATION)
+        memcpy(object->orientation, msg->orientation, sizeof(object->orientation));
+
+    if (msg->fields & OM_OBJECT_PATCH_T_BBOX) {
+        memcpy(object->bbox_min, msg->bbox_min, sizeof(object->bbox_min));
+        memcpy(object->bbox_max, msg->bbox_max, sizeof(object->bbox_max));
+    }
+    if (msg->fields & OM_OBJECT_PATCH_T_OBJECT_TYPE)
+        object->object_type = msg->object_type;
+    if (msg->fields & OM_OBJECT_PATCH_T_LABEL) {
+        free(object->label);
+        object->label = strdup(msg->label ? msg->label : "");
+    }
+
+    // keep full updates made before the patch from undoing it
+    object->utime = MAX(object->utime, msg->utime);
+    object_entry_pose_set(entry);
+    dynamic_objects_object_changed(self, entry, self->version + 1);
+
+    if (self->verbose)
+        fprintf (stdout, "Patched object id = %"PRId64" (fields 0x%x)\n",
+                 msg->id, msg->fields);
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+dynamic_objects_publish_replica_delta(dynamic_objects_t *self, GList *entries,
+                                      int64_t base_version)
+{
+    int nobjects = g_list_length(entries);
+    om_replica_delta_t msg = {
+        .utime = bot_timestamp_now(),
+        .server_id = self->server_id,
+        .base_version = base_version,
+        .version = self->version,
+        .num_objects = nobjects,
+        .objects = calloc(nobjects ? nobjects : 1, sizeof(om_object_t)),
+        .object_versions = calloc(nobjects ? nobjects : 1, sizeof(int64_t)),
+        .parent_ids = calloc(nobjects ? nobjects : 1, sizeof(int64_t))
+    };
+    int idx = 0;
+    for (GList *iter = entries; iter; iter = iter->next, idx++) {
+        object_entry_t *entry = iter->data;
+        memcpy(&msg.objects[idx], object_entry_world(entry), sizeof(om_object_t));
+        msg.object_versions[idx] = entry->version;
+        msg.parent_ids[idx] = entry->parent ? entry->parent->object.id : 0;
+    }
+    om_replica_delta_t_publish(self->lcm, REPLICA_DELTA_CHANNEL, &msg);
+    free(msg.objects);
+    free(msg.object_versions);
+    free(msg.parent_ids);
+}
+
+static int64_t
+dynamic_objects_new_epoch(void)
+{
+    return ((int64_t)(g_random_int() & 0x7fffffff) << 32) | g_random_int();
+}
+
+static void
+dynamic_objects_request_sync(dynamic_objects_t *self)
+{
+    int64_t now = bot_timestamp_now();
+    if (now - self->last_sync_request_utime < SYNC_RETRY_USEC)
+        return;
+    self->last_sync_request_utime = now;
+
+    om_replica_sync_request_t req = {
+        .utime = now,
+        .server_id = self->server_id,
+        .have_version = self->version
+    };
+    om_replica_sync_request_t_publish(self->lcm, REPLICA_SYNC_CHANNEL, &req);
+}
+
+static void
+dynamic_objects_become_primary(dynamic_objects_t *self)
+{
+    fprintf (stdout, "No word from the primary for %.1f s, taking over at "
+             "version %"PRId64" with %d objects\n", PRIMARY_TIMEOUT_USEC*1e-6,
+             self->version, g_hash_table_size(self->objects));
+    self->role = ROLE_PRIMARY;
+    // clients can't tell our versions from those of the old primary
+    self->epoch = dynamic_objects_new_epoch();
+    self->replicated_version = self->version;
+    g_hash_table_remove_all(self->changed);
+
+    // never hand out a block twice, nor ids the world already has
+    self->next_id_block += ID_BLOCK_FAILOVER_GAP;
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, self->objects);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        int64_t id = *(int64_t *)key;
+        if (id >= self->next_id_block && id < OM_ID_BLOCK_END)
+            self->next_id_block = id + 1;
+    }
+}
+
+/*
+ * Steps down in favor of another primary. Whatever we accepted while the
+ * two of us could not see each other is handed to the new primary through
+ * its regular update path, which keeps the newer copy of every object.
+ * Then we start over from a snapshot.
+ */
+static void
+dynamic_objects_become_backup(dynamic_objects_t *self, int64_t primary_id)
+{
+    fprintf (stdout, "Server %"PRId64" is primary, stepping down\n", primary_id);
+
+    GList *entries = g_hash_table_get_values(self->objects);
+    int nobjects = g_list_length(entries);
+    om_object_list_t list = {
+        .utime = bot_timestamp_now(),
+        .num_objects = nobjects,
+        .objects = calloc(nobjects ? nobjects : 1, sizeof(om_object_t))
+    };
+    int idx = 0;
+    for (GList *iter = entries; iter; iter = iter->next) {
+        object_entry_t *entry = iter->data;
+        memcpy(&list.objects[idx++], object_entry_world(entry), sizeof(om_object_t));
+        if (self->grid)
+            obstacle_grid_remove_object(self->grid, entry->object.id);
+    }
+    if (nobjects)
+        om_object_list_t_publish(self->lcm, REPLICA_HANDOFF_CHANNEL, &list);
+    free(list.objects);
+    g_list_free(entries);
+
+    if (self->grid_dirty)
+        g_hash_table_remove_all(self->grid_dirty);
+    g_hash_table_remove_all(self->region_dirty);
+    region_monitor_clear_objects(self->regions);
+    g_hash_table_remove_all(self->changed);
+    g_hash_table_remove_all(self->objects);
+
+    self->role = ROLE_BACKUP;
+    self->version = 0;
+    self->replicated_version = 0;
+    self->last_primary_utime = bot_timestamp_now();
+    self->last_sync_request_utime = 0;
+    dynamic_objects_request_sync(self);
+}
+
+/*
+ * Returns TRUE if a message from the primary other_id, at other_version,
+ * should be followed. Two primaries can only meet after a partition; the
+ * one further ahead wins, ties go to the lower server id.
+ */
+static gboolean
+dynamic_objects_heard_primary(dynamic_objects_t *self, int64_t other_id,
+                              int64_t other_version)
+{
+    if (self->role == ROLE_PRIMARY) {
+        if (other_version < self->version ||
+            (other_version == self->version && other_id > self->server_id))
+            return FALSE;
+        dynamic_objects_become_backup(self, other_id);
+    }
+    self->last_primary_utime = bot_timestamp_now();
+    return TRUE;
+}
+
+static void
+on_replica_delta(const lcm_recv_buf_t *rbuf, const char *channel,
+                 const om_replica_delta_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    if (msg->server_id == self->server_id)
+        return;
+
+    g_mutex_lock(self->mutex);
+    if (!dynamic_objects_heard_primary(self, msg->server_id, msg->version)) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    if (msg->base_version > self->version) {
+        // we missed part of the stream, catch up before applying anything
+        dynamic_objects_request_sync(self);
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    // all poses first, so that attaching below finds parents where they
+    // are now
+    object_entry_t **applied = calloc(msg->num_objects ? msg->num_objects : 1,
+                                      sizeof(object_entry_t *));
+    for (int i = 0; i < msg->num_objects; i++) {
+        const om_object_t *object = &msg->objects[i];
+        object_entry_t *entry = g_hash_table_lookup(self->objects, &object->id);
+        if (entry && entry->version >= msg->object_versions[i])
+            continue;
+
+        if (!entry) {
+            entry = object_entry_new(object);
+            g_hash_table_insert(self->objects, &entry->object.id, entry);
+        }
+        else {
+            object_entry_set(entry, object);
+        }
+        entry->world_dirty = FALSE;
+        applied[i] = entry;
+    }
+    for (int i = 0; i < msg->num_objects; i++) {
+        object_entry_t *entry = applied[i];
+        if (!entry)
+            continue;
+        if (!dynamic_objects_attach(self, entry, msg->parent_ids[i]))
+            ERR("Error: replica delta can't attach %"PRId64" to %"PRId64"\n",
+                entry->object.id, msg->parent_ids[i]);
+        object_entry_pose_set(entry);
+        dynamic_objects_object_changed(self, entry, msg->object_versions[i]);
+    }
+    free(applied);
+    if (msg->version > self->version)
+        self->version = msg->version;
+
+    if (self->verbose)
+        fprintf (stdout, "Applied replica delta %"PRId64" -> %"PRId64" (%d objects)\n",
+                 msg->base_version, msg->version, msg->num_objects);
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+on_replica_heartbeat(const lcm_recv_buf_t *rbuf, const char *channel,
+                     const om_replica_heartbeat_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    if (msg->server_id == self->server_id)
+        return;
+
+    g_mutex_lock(self->mutex);
+    // heartbeats follow the delta of the same tick, so being behind here
+    // means that delta got lost
+    if (dynamic_objects_heard_primary(self, msg->server_id, msg->version)) {
+        if (msg->version > self->version)
+            dynamic_objects_request_sync(self);
+        if (msg->next_id_block > self->next_id_block)
+            self->next_id_block = msg->next_id_block;
+    }
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+on_replica_sync_request(const lcm_recv_buf_t *rbuf, const char *channel,
+                        const om_replica_sync_request_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    if (msg->server_id == self->server_id)
+        return;
+
+    g_mutex_lock(self->mutex);
+    if (self->role == ROLE_PRIMARY) {
+        // everything the standby has not seen yet; a snapshot if it has nothing
+        GList *entries = NULL;
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, self->objects);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            if (((object_entry_t *)value)->version > msg->have_version)
+                entries = g_list_prepend(entries, value);
+
+        if (self->verbose)
+            fprintf (stdout, "Server %"PRId64" asked to catch up from version %"PRId64
+                     ", sending %d objects\n", msg->server_id, msg->have_version,
+                     g_list_length(entries));
+        dynamic_objects_publish_replica_delta(self, entries, msg->have_version);
+        g_list_free(entries);
+    }
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+dynamic_objects_replicate(dynamic_objects_t *self)
+{
+    g_mutex_lock(self->mutex);
+    int64_t now = bot_timestamp_now();
+
+    if (self->role == ROLE_BACKUP) {
+        if (now - self->last_primary_utime > PRIMARY_TIMEOUT_USEC)
+            dynamic_objects_become_primary(self);
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    if (g_hash_table_size(self->changed)) {
+        GList *entries = g_hash_table_get_values(self->changed);
+        dynamic_objects_publish_replica_delta(self, entries, self->replicated_version);
+        g_list_free(entries);
+        g_hash_table_remove_all(self->changed);
+        self->replicated_version = self->version;
+    }
+
+    if (!(self->tick % (OBJECTS_PUBLISH_HZ / HEARTBEAT_HZ))) {
+        om_replica_heartbeat_t hb = {
+            .utime = now,
+            .server_id = self->server_id,
+            .version = self->replicated_version,
+            .num_objects = g_hash_table_size(self->objects),
+            .next_id_block = self->next_id_block
+        };
+        om_replica_heartbeat_t_publish(self->lcm, REPLICA_HEARTBEAT_CHANNEL, &hb);
+    }
+    g_mutex_unlock(self->mutex);
+}
+
 
 int
 _matrix_to_quat_pos(const double mat[16], double quat[4], double pos[3]) 
@@ -147,11 +754,10 @@ _matrix_to_quat_pos(const double mat[16], double quat[4], double pos[3])
     return bot_matrix_to_quat(rot,quat);
 }
 
+// Fills self->object_list with the current store, mutex must be held.
 static void
-dynamic_objects_publish_object_list(dynamic_objects_t *self)
+dynamic_objects_fill_object_list(dynamic_objects_t *self)
 {
-    g_mutex_lock(self->mutex);
-
     GList *objects = g_hash_table_get_values (self->objects);
     
     int nobjects = g_list_length(objects);
@@ -166,14 +772,145 @@ dynamic_objects_publish_object_list(dynamic_objects_t *self)
     self->object_list.utime = now;
     int idx=0;
     for (GList *iter = objects; iter; iter=iter->next) {
-        memcpy(&self->object_list.objects[idx++],iter->data,sizeof(om_object_t));
+        object_entry_t *entry = iter->data;
+        memcpy(&self->object_list.objects[idx++],object_entry_world(entry),sizeof(om_object_t));
     }
-    om_object_list_t_publish(self->lcm, "OBJECT_LIST", &self->object_list);
     g_list_free(objects);
+}
+
+// Publishes self->object_list as chunks of at most self->chunk_bytes each
+// (an object larger than that gets a chunk of its own), answering the sync
+// request request_id if that is not 0. Mutex must be held.
+static void
+dynamic_objects_publish_object_list_chunks(dynamic_objects_t *self,
+                                           const char *channel,
+                                           int64_t request_id)
+{
+    om_object_list_t *list = &self->object_list;
+
+    // first pass finds where every chunk starts, so each knows num_chunks
+    GArray *starts = g_array_new(FALSE, FALSE, sizeof(int));
+    int bytes = 0;
+    for (int i = 0; i < list->num_objects; i++) {
+        int size = om_object_t_encoded_size(&list->objects[i]);
+        if (i == 0 || bytes + size > self->chunk_bytes) {
+            g_array_append_val(starts, i);
+            bytes = 0;
+        }
+        bytes += size;
+    }
+
+    om_object_list_chunk_t chunk = {
+        .utime = list->utime,
+        .request_id = request_id,
+        .version = self->version,
+        .epoch = self->epoch,
+        .num_chunks = starts->len,
+        .total_objects = list->num_objects
+    };
+    for (int c = 0; c < starts->len; c++) {
+        int first = g_array_index(starts, int, c);
+        int end = (c + 1 < starts->len) ?
+            g_array_index(starts, int, c + 1) : list->num_objects;
+        chunk.chunk_index = c;
+        chunk.first_index = first;
+        chunk.num_objects = end - first;
+        chunk.objects = &list->objects[first];
+        om_object_list_chunk_t_publish(self->lcm, channel, &chunk);
+    }
+    g_array_free(starts, TRUE);
+}
+
+static void
+dynamic_objects_publish_object_list(dynamic_objects_t *self)
+{
+    g_mutex_lock(self->mutex);
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    dynamic_objects_fill_object_list(self);
+    if (self->chunk_bytes > 0 &&
+        om_object_list_t_encoded_size(&self->object_list) > self->chunk_bytes)
+        dynamic_objects_publish_object_list_chunks(self,
+                                                   OBJECT_LIST_CHUNK_CHANNEL, 0);
+    else
+        om_object_list_t_publish(self->lcm, "OBJECT_LIST", &self->object_list);
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+on_sync_request(const lcm_recv_buf_t *rbuf, const char *channel,
+                const om_sync_request_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    g_mutex_lock(self->mutex);
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    om_object_list_sync_t sync = {
+        .utime = bot_timestamp_now(),
+        .request_id = msg->request_id,
+        .version = self->version,
+        .epoch = self->epoch,
+        .unchanged = (msg->have_epoch == self->epoch &&
+                      msg->have_version == self->version)
+    };
+    if (sync.unchanged) {
+        sync.list.utime = sync.utime;
+    }
+    else {
+        dynamic_objects_fill_object_list(self);
+        sync.list = self->object_list;
+    }
+    // a large world goes the same way as a large periodic list
+    if (!sync.unchanged && self->chunk_bytes > 0 &&
+        om_object_list_t_encoded_size(&sync.list) > self->chunk_bytes)
+        dynamic_objects_publish_object_list_chunks(self, SYNC_CHUNK_CHANNEL,
+                                                   msg->request_id);
+    else
+        om_object_list_sync_t_publish(self->lcm, SYNC_CHANNEL, &sync);
+
+    if (self->verbose)
+        fprintf (stdout, "Answered sync request %"PRId64" at version %"PRId64
+                 " with %d objects\n", msg->request_id, self->version,
+                 sync.list.num_objects);
+    g_mutex_unlock(self->mutex);
+}
+
+static void
+on_id_block_request(const lcm_recv_buf_t *rbuf, const char *channel,
+                    const om_id_block_request_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    g_mutex_lock(self->mutex);
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    om_id_block_t block = {
+        .utime = bot_timestamp_now(),
+        .request_id = msg->request_id,
+        .first_id = self->next_id_block,
+        .count = CLAMP(msg->count, 1, OM_ID_BLOCK_MAX)
+    };
+    if (block.first_id + block.count > OM_ID_BLOCK_END) {
+        ERR("Error: out of id blocks\n");
+        block.count = 0;
+    }
+    self->next_id_block += block.count;
+    om_id_block_t_publish(self->lcm, OM_ID_BLOCK_CHANNEL, &block);
+
+    if (self->verbose)
+        fprintf (stdout, "Reserved ids %"PRId64" to %"PRId64" for request %"PRId64"\n",
+                 block.first_id, block.first_id + block.count - 1, msg->request_id);
     g_mutex_unlock(self->mutex);
 }
 
-/*
 static void
 dynamic_objects_publish_rects(dynamic_objects_t *self)
 {
@@ -181,130 +918,124 @@ dynamic_objects_publish_rects(dynamic_objects_t *self)
         return;
 
     g_mutex_lock(self->mutex);
-    GList *pallets = g_hash_table_get_values (self->pallets);
-    GList *objects = g_hash_table_get_values (self->objects);
-    
-    int npallets = g_list_length(pallets);
-    int nobjects = g_list_length(objects);
-    int nrects = npallets+nobjects;
-    if (self->obstacle_list_num_alloc_rects<nrects) {
-        if (self->obstacle_list.rects.rects)
-            free(self->obstacle_list.rects.rects);
-        self->obstacle_list_num_alloc_rects=nrects;
-        self->obstacle_list.rects.rects=calloc(nrects,sizeof(arlcm_rect_t));
-    }
-    arlcm_rect_t *rect = self->obstacle_list.rects.rects;
-    int64_t now = bot_timestamp_now();
-    self->obstacle_list.rects.utime = now;
-    self->obstacle_list.tracks.utime = now;
-    //double pos_pose[3]={0.0, 0.0, 0.0};
-    botlcm_pose_t local_pose;
-    atrans_get_local_pose(self->atrans, &local_pose);
-    //self->obstacle_list.rects.xy[0]=pos_pose[0];
-    //self->obstacle_list.rects.xy[1]=pos_pose[1];
-    self->obstacle_list.rects.xy[0]=local_pose.pos[0];
-    self->obstacle_list.rects.xy[1]=local_pose.pos[1];
-    // make rects for pallets
-    int count=0;
-    int64_t ignore_object_id=-1;
-    for (GList *iter = pallets; iter; iter=iter->next) {
-        arlcm_pallet_t *pallet = iter->data;
-        if (self->last_man_status.pallet_id==pallet->id) {
-            // we are trying to pick up this pallet so don't put a rect under it.
-            if (pallet->relative_to_id)
-                ignore_object_id = pallet->relative_to_id;
-            continue;
-        }
-        // if relative to an object instead of world frame we don't want to put an obstacle rect there
-        // because this would mean the pallet is on a truck or on the tines
-        // either way we don't need to put an obstacle rect there.
-        if ((pallet->relative_to_id != GLOBAL_FRAME_ID && pallet->relative_to_id != LOCAL_FRAME_ID) 
-            || (pallet->pallet_type==ARLCM_PALLET_ENUM_T_PHANTOM))
-            continue;
+    if (self->role != ROLE_PRIMARY) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
 
-        
-        // If the pallet is relative to the global frame, grab pose in local frame
-        double pallet_pos_local[3];
-        double pallet_quat_local[4];
-        if (pallet->relative_to_id == GLOBAL_FRAME_ID) {
-            BotTrans global_to_local;
-            if (!atrans_get_trans (self->atrans, "global", "local",
-                                   &global_to_local)) {
-                fprintf (stderr, "dynamic_objects_publish_rects: Error converting from global to local for pallet pose\n");
-                continue;
-            }
-                
-            // Create and apply the transformation for my pallet as
-            BotTrans pallet_trans;
-            bot_trans_set_from_quat_trans (&pallet_trans, pallet->orientation,
-                                           pallet->pos);
-            bot_trans_apply_trans ( &pallet_trans, &global_to_local);
-            
-            memcpy (pallet_quat_local, pallet_trans.rot_quat, 4*sizeof(double));
-            memcpy (pallet_pos_local, pallet_trans.trans_vec, 3*sizeof(double));
-        }
-        else {
-            memcpy (pallet_quat_local, pallet->orientation, 4*sizeof(double));
-            memcpy (pallet_pos_local, pallet->pos, 3*sizeof(double));
-        }
+    // only objects that were touched since the last tick can have a new
+    // footprint; the grid itself skips the ones that merely got a new utime
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->grid_dirty);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        obstacle_grid_update_object(self->grid, value);
+    g_hash_table_remove_all(self->grid_dirty);
 
+    gboolean keyframe = !(self->grid_publish_count++ % GRID_KEYFRAME_INTERVAL);
+    obstacle_grid_publish(self->grid, self->lcm, OBSTACLE_GRID_CHANNEL,
+                          bot_timestamp_now(), keyframe);
+    g_mutex_unlock(self->mutex);
+}
 
-        rect->size[0]= pallet->bbox_max[0]-pallet->bbox_min[0];
-        rect->size[1]= pallet->bbox_max[1]-pallet->bbox_min[1];
-        double rpy_pallet[3];
-        bot_quat_to_roll_pitch_yaw(pallet_quat_local, rpy_pallet);
-        rect->theta=rpy_pallet[2];
-        double offset[2] = {pallet->bbox_min[0]+rect->size[0]/2.0,
-                            pallet->bbox_min[1]+rect->size[1]/2.0};
-        double sintheta,costheta;
-        bot_fasttrig_sincos(rect->theta,&sintheta,&costheta);
-        //rect->dxy[0]= pallet->pos[0]-pos_pose[0] + (costheta*offset[0]-sintheta*offset[1]);
-        //rect->dxy[1]= pallet->pos[1]-pos_pose[1] + (sintheta*offset[0]+costheta*offset[1]);
-        rect->dxy[0]= pallet_pos_local[0]-local_pose.pos[0] + (costheta*offset[0]-sintheta*offset[1]);
-        rect->dxy[1]= pallet_pos_local[1]-local_pose.pos[1] + (sintheta*offset[0]+costheta*offset[1]);
-        //fprintf (stdout, "Adding pallet rect at dxy[0] = %.2f and dxy[1] = %.2f\n", rect->dxy[0], rect->dxy[1]);
-        rect++;
-        count++;
-    }
-    g_list_free(pallets);
-    // make rects for objects
-    for (GList *iter = objects; iter; iter=iter->next) {
-        arlcm_object_t *object = iter->data;
-        // we are trying to approach this object to pick up a pallet so don't make an obstacle rect for it.
-        if (object->id==ignore_object_id) 
-            continue;
+/*
+ * Standbys follow objects through regions as well, so that a new primary
+ * knows who is in them, but only the primary reports.
+ */
+static void
+on_region_event(const om_region_event_t *event, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    if (self->role == ROLE_PRIMARY)
+        om_region_event_t_publish(self->lcm, REGION_EVENT_CHANNEL, event);
+}
 
-        rect->size[0]= object->bbox_max[0]-object->bbox_min[0];
-        rect->size[1]= object->bbox_max[1]-object->bbox_min[1];
-        double rpy_object[3];
-        bot_quat_to_roll_pitch_yaw(object->orientation,rpy_object);
-        rect->theta=rpy_object[2];
-        double offset[2] = {object->bbox_min[0]+rect->size[0]/2.0,
-                            object->bbox_min[1]+rect->size[1]/2.0};
-        double sintheta,costheta;
-        bot_fasttrig_sincos(rect->theta,&sintheta,&costheta);
-        //rect->dxy[0]= object->pos[0]-pos_pose[0] + (costheta*offset[0]-sintheta*offset[1]);
-        //rect->dxy[1]= object->pos[1]-pos_pose[1] + (sintheta*offset[0]+costheta*offset[1]);
-        rect->dxy[0]= object->pos[0]-local_pose.pos[0] + (costheta*offset[0]-sintheta*offset[1]);
-        rect->dxy[1]= object->pos[1]-local_pose.pos[1] + (sintheta*offset[0]+costheta*offset[1]);
-        rect++;
-        count++;
-    }
-    g_list_free(objects);
-    self->obstacle_list.rects.num_rects=count;
-    
-    arlcm_obstacle_list_t_publish(self->lcm, "OBSTACLES", &self->obstacle_list);
+static void
+on_region(const lcm_recv_buf_t *rbuf, const char *channel,
+          const om_region_t *msg, void *user)
+{
+    dynamic_objects_t *self = (dynamic_objects_t*)user;
+    g_mutex_lock(self->mutex);
+    region_monitor_set_region(self->regions, msg, bot_timestamp_now());
+    if (self->verbose)
+        fprintf (stdout, "%s region %"PRId64" (%s)\n",
+                 msg->remove ? "Removed" : "Registered", msg->region_id, msg->name);
+    g_mutex_unlock(self->mutex);
+}
+
+// what is attached to entry moved with it
+static void
+dynamic_objects_update_regions(dynamic_objects_t *self, object_entry_t *entry,
+                               int64_t now)
+{
+    region_monitor_update_object(self->regions, object_entry_world(entry), now);
+    for (GSList *iter = entry->children; iter; iter = iter->next)
+        dynamic_objects_update_regions(self, iter->data, now);
+}
+
+static void
+dynamic_objects_check_regions(dynamic_objects_t *self)
+{
+    g_mutex_lock(self->mutex);
+    int64_t now = bot_timestamp_now();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->region_dirty);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        dynamic_objects_update_regions(self, value, now);
+    g_hash_table_remove_all(self->region_dirty);
+    region_monitor_check_dwell(self->regions, now);
     g_mutex_unlock(self->mutex);
 }
-*/
 
+static void
+dynamic_objects_publish_shm(dynamic_objects_t *self)
+{
+    if (!self->shm_name)
+        return;
+
+    g_mutex_lock(self->mutex);
+    // standbys leave the segment alone, it belongs to the primary
+    if (self->role != ROLE_PRIMARY ||
+        (self->shm && self->shm_version == self->version)) {
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+    if (!self->shm && !(self->shm = object_shm_writer_new(self->shm_name))) {
+        ERR("Error: not publishing to shared memory\n");
+        free(self->shm_name);
+        self->shm_name = NULL;
+        g_mutex_unlock(self->mutex);
+        return;
+    }
+
+    int nobjects = g_hash_table_size(self->objects);
+    om_object_t **objects = malloc((nobjects ? nobjects : 1) * sizeof(om_object_t *));
+    GHashTableIter iter;
+    gpointer value;
+    int idx = 0;
+    g_hash_table_iter_init(&iter, self->objects);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        objects[idx++] = object_entry_world(value);
+
+    if (!object_shm_writer_publish(self->shm, bot_timestamp_now(), self->version,
+                                   objects, nobjects))
+        self->shm_version = self->version;
+    free(objects);
+    g_mutex_unlock(self->mutex);
+}
 
 static gboolean
 on_timer(gpointer data)
 {
     dynamic_objects_t *self = (dynamic_objects_t*)data;
     g_assert(self);
+    dynamic_objects_replicate(self);
     dynamic_objects_publish_object_list(self);
+    dynamic_objects_publish_rects(self);
+    dynamic_objects_check_regions(self);
+    dynamic_objects_publish_shm(self);
+    self->tick++;
     return TRUE;
 }
 
@@ -314,6 +1045,21 @@ dynamic_objects_destroy(dynamic_objects_t *self)
     if (!self)
         return;
 
+    if (self->grid_dirty)
+        g_hash_table_destroy(self->grid_dirty);
+
+    obstacle_grid_destroy(self->grid);
+
+    region_monitor_destroy(self->regions);
+    if (self->region_dirty)
+        g_hash_table_destroy(self->region_dirty);
+
+    object_shm_writer_destroy(self->shm);
+    free(self->shm_name);
+
+    if (self->changed)
+        g_hash_table_destroy(self->changed);
+
     if (self->objects)
         g_hash_table_destroy(self->objects);
 
@@ -356,14 +1102,38 @@ dynamic_objects_create()
     }
     
     /* create hash tables */
-    self->objects = g_hash_table_new(_g_int64_t_hash,_g_int64_t_equal);
-    if (!self->objects) {
+    self->objects = g_hash_table_new_full(_g_int64_t_hash,_g_int64_t_equal,
+                                          NULL, (GDestroyNotify)object_entry_destroy);
+    self->changed = g_hash_table_new(_g_int64_t_hash,_g_int64_t_equal);
+    self->region_dirty = g_hash_table_new(_g_int64_t_hash,_g_int64_t_equal);
+    if (!self->objects || !self->changed || !self->region_dirty) {
         ERR("Error: dynamic_objects_create() failed to create the object array\n");
         goto fail;
     }
+    self->regions = region_monitor_new(REGION_BUCKET_SIZE, on_region_event, self);
 
     /* subscribe to update channels */
     om_object_list_t_subscribe(self->lcm, "OBJECTS_UPDATE.*", on_objects_update, self);
+    om_object_patch_t_subscribe(self->lcm, PATCH_CHANNEL, on_object_patch, self);
+    om_region_t_subscribe(self->lcm, REGION_CHANNEL, on_region, self);
+    om_sync_request_t_subscribe(self->lcm, SYNC_REQUEST_CHANNEL, on_sync_request, self);
+    om_id_block_request_t_subscribe(self->lcm, OM_ID_BLOCK_REQUEST_CHANNEL,
+                                    on_id_block_request, self);
+
+    /* replication */
+    self->server_id = ((int64_t)(g_random_int() & 0x7fffffff) << 32) | g_random_int();
+    self->epoch = dynamic_objects_new_epoch();
+    self->role = ROLE_PRIMARY;
+    // a restarted server can't know what it handed out before, so every
+    // run starts at a random place in the block range
+    self->next_id_block = OM_ID_BLOCK_BASE +
+        ((int64_t)(g_random_int() & 0x7fffffff) << 24);
+    om_replica_delta_t_subscribe(self->lcm, REPLICA_DELTA_CHANNEL,
+                                 on_replica_delta, self);
+    om_replica_heartbeat_t_subscribe(self->lcm, REPLICA_HEARTBEAT_CHANNEL,
+                                     on_replica_heartbeat, self);
+    om_replica_sync_request_t_subscribe(self->lcm, REPLICA_SYNC_CHANNEL,
+                                        on_replica_sync_request, self);
 
     return self;
  fail:
@@ -380,10 +1150,19 @@ static void usage(int argc, char ** argv)
              "\n"
              "  -v, --verbose          verbose output\n"
              "  -h, --help             shows this help text and exits\n"
-             "  -r, --rects            publish rects\n"             
+             "  -r, --rects            publish an obstacle grid of object footprints\n"
+             "  -R, --grid-res <m>     obstacle grid cell size (default %.2f m)\n"
              "  -g, --global           maintain pose estimates in GLOBAL frame\n"
+             "  -b, --backup           start as hot standby of a running server;\n"
+             "                         take over if the primary goes silent\n"
+             "  -i, --server-id <id>   id used to tell replicas apart (default random)\n"
+             "  -s, --shm <name>       also publish into shared memory segment <name>\n"
+             "                         for readers on this host (e.g. %s)\n"
+             "  -c, --chunk-bytes <n>  split object lists larger than <n> bytes into\n"
+             "                         chunks, 0 to never split (default %d)\n"
              "\n",
-             argv[0]);
+             argv[0], GRID_RESOLUTION_DEFAULT, OM_SHM_DEFAULT_NAME,
+             CHUNK_BYTES_DEFAULT);
 }
 
 
@@ -396,14 +1175,22 @@ int main(int argc, char *argv[])
     if (!self)
         return 1;
     
-    char *optstring = "hrgv";
+    self->grid_resolution = GRID_RESOLUTION_DEFAULT;
+    self->chunk_bytes = CHUNK_BYTES_DEFAULT;
+
+    char *optstring = "hrR:gvbi:s:c:";
     char c;
     struct option long_opts[] =
     {
         { "help",      no_argument,       0, 'h' },
         { "rects",     no_argument,       0, 'r' },
+        { "grid-res",  required_argument, 0, 'R' },
         { "global",    no_argument,       0, 'g' },
         { "verbose",   no_argument,       0, 'v' },
+        { "backup",    no_argument,       0, 'b' },
+        { "server-id", required_argument, 0, 'i' },
+        { "shm",       required_argument, 0, 's' },
+        { "chunk-bytes", required_argument, 0, 'c' },
         { 0, 0, 0, 0}
     };
     
@@ -411,12 +1198,31 @@ int main(int argc, char *argv[])
     {
         switch (c) 
         {
+            case 'r':
+                self->publish_rects = TRUE;
+                break;
+            case 'R':
+                self->grid_resolution = strtod(optarg, NULL);
+                break;
             case 'g': 
                 self->use_global_pose = TRUE; 
                 break;
             case 'v': 
                 self->verbose = TRUE; 
                 break;
+            case 'b':
+                self->role = ROLE_BACKUP;
+                break;
+            case 'i':
+                self->server_id = strtoll(optarg, NULL, 10);
+                break;
+            case 's':
+                free(self->shm_name);
+                self->shm_name = strdup(optarg);
+                break;
+            case 'c':
+                self->chunk_bytes = atoi(optarg);
+                break;
             case 'h':
             default:
                 usage(argc, argv); 
@@ -424,6 +1230,21 @@ int main(int argc, char *argv[])
         }
     }
     
+    if (self->role == ROLE_BACKUP) {
+        // give the primary a full timeout to show up before taking over
+        self->last_primary_utime = bot_timestamp_now();
+        dynamic_objects_request_sync(self);
+    }
+
+    if (self->publish_rects) {
+        self->grid = obstacle_grid_new(self->grid_resolution, GRID_TILE_SIZE);
+        if (!self->grid) {
+            dynamic_objects_destroy(self);
+            return 1;
+        }
+        self->grid_dirty = g_hash_table_new(_g_int64_t_hash, _g_int64_t_equal);
+    }
+
     int return_code = 0;
 
     if (bot_signal_pipe_glib_quit_on_kill(self->main_loop)) {
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "object_shm_writer.h"
+
+#define ERR(...) do { fprintf(stderr, "[%s:%d] ", __FILE__, __LINE__); \
+                      fprintf(stderr, __VA_ARGS__); fflush(stderr); } while(0)
+
+#define MIN_OBJECTS 256
+#define MIN_LABEL_CAPACITY 8192
+
+struct _object_shm_writer {
+    char            *name;
+    om_shm_header_t *hdr;
+    size_t           size;
+};
+
+/*
+ * Creates a fresh segment under the writer's name, with its header filled
+ * in but without the magic, so readers that find it leave it alone until
+ * writer_activate(). POSIX shared memory can't be renamed, so the name has
+ * to be freed first; readers that miss it keep the world they have.
+ */
+static om_shm_header_t *
+writer_create(object_shm_writer_t *writer, uint32_t max_objects,
+              uint32_t label_capacity, size_t *size_out)
+{
+    shm_unlink(writer->name);
+    int fd = shm_open(writer->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        ERR("Error: could not create shared memory segment %s: %s\n",
+            writer->name, strerror(errno));
+        return NULL;
+    }
+
+    size_t size = om_shm_segment_size(max_objects, label_capacity);
+    if (ftruncate(fd, size) < 0) {
+        ERR("Error: could not size shared memory segment %s: %s\n",
+            writer->name, strerror(errno));
+        close(fd);
+        shm_unlink(writer->name);
+        return NULL;
+    }
+
+    om_shm_header_t *hdr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        ERR("Error: could not map shared memory segment %s: %s\n",
+            writer->name, strerror(errno));
+        shm_unlink(writer->name);
+        return NULL;
+    }
+
+    // the segment comes zero filled
+    hdr->layout_version = OM_SHM_LAYOUT_VERSION;
+    hdr->max_objects = max_objects;
+    hdr->label_capacity = label_capacity;
+    hdr->buffer_size = (size - sizeof(om_shm_header_t)) / 2;
+    *size_out = size;
+    return hdr;
+}
+
+/*
+ * Publishes the magic of a new segment, whose active buffer must already
+ * hold the current world, then marks the one it replaces stale so readers
+ * move over.
+ */
+static void
+writer_activate(object_shm_writer_t *writer, om_shm_header_t *hdr, size_t size)
+{
+    __sync_synchronize();
+    hdr->magic = OM_SHM_MAGIC;
+    __sync_synchronize();
+
+    if (writer->hdr) {
+        writer->hdr->stale = 1;
+        __sync_synchronize();
+        munmap(writer->hdr, writer->size);
+    }
+    writer->hdr = hdr;
+    writer->size = size;
+}
+
+object_shm_writer_t *
+object_shm_writer_new(const char *name)
+{
+    object_shm_writer_t *writer = calloc(1, sizeof(object_shm_writer_t));
+    writer->name = strdup(name);
+    size_t size;
+    om_shm_header_t *hdr = writer_create(writer, MIN_OBJECTS,
+                                         MIN_LABEL_CAPACITY, &size);
+    if (!hdr) {
+        object_shm_writer_destroy(writer);
+        return NULL;
+    }
+    // nothing published yet, the empty world is the current one
+    writer_activate(writer, hdr, size);
+    return writer;
+}
+
+void
+object_shm_writer_destroy(object_shm_writer_t *writer)
+{
+    if (!writer)
+        return;
+
+    if (writer->hdr) {
+        munmap(writer->hdr, writer->size);
+        shm_unlink(writer->name);
+    }
+    free(writer->name);
+    free(writer);
+}
+
+static int
+compare_object_ids(const void *a, const void *b)
+{
+    int64_t id_a = (*(om_object_t * const *)a)->id;
+    int64_t id_b = (*(om_object_t * const *)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/*
+ * Writes the objects, sorted by id, into buffer idx and makes it active.
+ */
+static void
+writer_write(om_shm_header_t *hdr, uint32_t idx, int64_t utime,
+             int64_t version, om_object_t **objects, int num_objects)
+{
+    om_shm_buffer_t *buf = om_shm_buffer(hdr, idx);
+    om_shm_object_t *records = om_shm_buffer_objects(buf);
+    char *labels = om_shm_buffer_labels(hdr, buf);
+
+    buf->seq++;
+    __sync_synchronize();
+
+    uint32_t label_offset = 0;
+    for (int i = 0; i < num_objects; i++) {
+        const om_object_t *obj = objects[i];
+        om_shm_object_t *rec = &records[i];
+        rec->utime = obj->utime;
+        rec->id = obj->id;
+        memcpy(rec->pos, obj->pos, sizeof(rec->pos));
+        memcpy(rec->orientation, obj->orientation, sizeof(rec->orientation));
+        memcpy(rec->bbox_min, obj->bbox_min, sizeof(rec->bbox_min));
+        memcpy(rec->bbox_max, obj->bbox_max, sizeof(rec->bbox_max));
+        rec->object_type = obj->object_type;
+        rec->label_offset = label_offset;
+
+        size_t len = obj->label ? strlen(obj->label) : 0;
+        memcpy(labels + label_offset, obj->label ? obj->label : "", len);
+        labels[label_offset + len] = '\0';
+        label_offset += len + 1;
+    }
+    buf->num_objects = num_objects;
+    buf->utime = utime;
+    buf->version = version;
+
+    __sync_synchronize();
+    buf->seq++;
+    __sync_synchronize();
+    hdr->active = idx;
+    hdr->generation++;
+    __sync_synchronize();
+}
+
+int
+object_shm_writer_publish(object_shm_writer_t *writer, int64_t utime,
+                          int64_t version, om_object_t **objects,
+                          int num_objects)
+{
+    size_t labels_size = 0;
+    for (int i = 0; i < num_objects; i++)
+        labels_size += (objects[i]->label ? strlen(objects[i]->label) : 0) + 1;
+
+    // readers look objects up by binary search on the id
+    qsort(objects, num_objects, sizeof(om_object_t *), compare_object_ids);
+
+    om_shm_header_t *hdr = writer->hdr;
+    if (num_objects <= hdr->max_objects && labels_size <= hdr->label_capacity) {
+        writer_write(hdr, !hdr->active, utime, version, objects, num_objects);
+        return 0;
+    }
+
+    // readers only move over to the larger segment once it holds this
+    // world; until then they keep reading the old one
+    uint32_t max_objects = MAX(hdr->max_objects, 2*num_objects);
+    uint32_t label_capacity = MAX(hdr->label_capacity, 2*labels_size);
+    size_t size;
+    om_shm_header_t *grown = writer_create(writer, max_objects,
+                                           label_capacity, &size);
+    if (!grown)
+        return -1;
+    writer_write(grown, 0, utime, version, objects, num_objects);
+    writer_activate(writer, grown, size);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef __OBJECT_SHM_WRITER_H
+#define __OBJECT_SHM_WRITER_H
+
+#include <lcmtypes/om_object_t.h>
+
+#include "object_shm.h"
+
+/*
+ * Publishes the world model into a POSIX shared memory segment laid out
+ * as described in object_shm.h.
+ */
+
+typedef struct _object_shm_writer object_shm_writer_t;
+
+object_shm_writer_t *object_shm_writer_new(const char *name);
+
+/* Unlinks the segment; readers that still have it mapped keep the last
+ * published world. */
+void object_shm_writer_destroy(object_shm_writer_t *writer);
+
+/* Writes the objects (in any order) to the inactive buffer and makes it
+ * active, growing the segment first if needed. Returns 0 on success. */
+int object_shm_writer_publish(object_shm_writer_t *writer, int64_t utime,
+                              int64_t version, om_object_t **objects,
+                              int num_objects);
+
+#endif
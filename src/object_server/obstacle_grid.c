@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <bot_core/bot_core.h>
+
+#include <lcmtypes/om_occupancy_grid_t.h>
+
+#include "obstacle_grid.h"
+
+#define ERR(...) do { fprintf(stderr, "[%s:%d] ", __FILE__, __LINE__); \
+                      fprintf(stderr, __VA_ARGS__); fflush(stderr); } while(0)
+
+// refuse to rasterize footprints larger than this many cells (bogus bboxes)
+#define MAX_FOOTPRINT_CELLS (1<<22)
+
+#define MAX_TILE_SIZE 128
+
+// cell indices must fit in int32_t with room to step past them
+#define MAX_CELL_INDEX (1<<30)
+
+typedef struct _grid_tile {
+    int64_t  key;           // tile_key(tx, ty)
+    int32_t  tx, ty;
+    int      occupied;      // number of cells with a non-zero count
+    gboolean dirty;
+    guint16 *counts;        // tile_size*tile_size footprint counts, row-major
+} grid_tile_t;
+
+typedef struct _footprint {
+    int64_t  id;
+    double   key[10];       // x, y, orientation, bbox_min[0..1], bbox_max[0..1]
+    int      num_cells;
+    int      max_cells;
+    int32_t *cells;         // (i, j) pairs of the cells last drawn
+} footprint_t;
+
+struct _obstacle_grid {
+    double resolution;
+    int    tile_size;
+
+    GHashTable  *tiles;         // tile key -> grid_tile_t
+    GHashTable  *footprints;    // object id -> footprint_t
+    GSList      *dirty;         // tiles changed since the last publish
+    grid_tile_t *last_tile;     // most recently touched tile
+
+    int64_t seq;
+};
+
+static gboolean
+_g_int64_t_equal (gconstpointer v1,gconstpointer v2) {
+    return (*(int64_t*)v1)==(*(int64_t*)v2);
+}
+
+static guint
+_g_int64_t_hash (gconstpointer v) {
+    // fold both halves, tile keys pack two 32 bit indices
+    int64_t k = *(int64_t *)v;
+    return (guint)(k ^ (k >> 32));
+}
+
+static inline int32_t
+floor_div(int32_t a, int32_t b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static inline int64_t
+tile_key(int32_t tx, int32_t ty)
+{
+    return ((int64_t)tx << 32) | (uint32_t)ty;
+}
+
+static void
+tile_destroy(grid_tile_t *tile)
+{
+    free(tile->counts);
+    free(tile);
+}
+
+static void
+footprint_destroy(footprint_t *fp)
+{
+    free(fp->cells);
+    free(fp);
+}
+
+static grid_tile_t *
+grid_get_tile(obstacle_grid_t *grid, int32_t tx, int32_t ty, gboolean create)
+{
+    if (grid->last_tile && grid->last_tile->tx == tx && grid->last_tile->ty == ty)
+        return grid->last_tile;
+
+    int64_t key = tile_key(tx, ty);
+    grid_tile_t *tile = g_hash_table_lookup(grid->tiles, &key);
+    if (!tile && create) {
+        tile = calloc(1, sizeof(grid_tile_t));
+        tile->key = key;
+        tile->tx = tx;
+        tile->ty = ty;
+        tile->counts = calloc(grid->tile_size * grid->tile_size, sizeof(guint16));
+        g_hash_table_insert(grid->tiles, &tile->key, tile);
+    }
+    if (tile)
+        grid->last_tile = tile;
+    return tile;
+}
+
+static void
+grid_cell_add(obstacle_grid_t *grid, int32_t i, int32_t j, int delta)
+{
+    int32_t tx = floor_div(i, grid->tile_size);
+    int32_t ty = floor_div(j, grid->tile_size);
+    grid_tile_t *tile = grid_get_tile(grid, tx, ty, delta > 0);
+    if (!tile)
+        return;
+
+    guint16 *count = &tile->counts[(j - ty*grid->tile_size)*grid->tile_size +
+                                   (i - tx*grid->tile_size)];
+    gboolean changed = FALSE;
+    if (delta > 0) {
+        if ((*count)++ == 0) {
+            tile->occupied++;
+            changed = TRUE;
+        }
+    }
+    else if (*count && --(*count) == 0) {
+        tile->occupied--;
+        changed = TRUE;
+    }
+
+    if (changed && !tile->dirty) {
+        tile->dirty = TRUE;
+        grid->dirty = g_slist_prepend(grid->dirty, tile);
+    }
+}
+
+static void
+footprint_clear(obstacle_grid_t *grid, footprint_t *fp)
+{
+    for (int c = 0; c < fp->num_cells; c++)
+        grid_cell_add(grid, fp->cells[2*c], fp->cells[2*c+1], -1);
+    fp->num_cells = 0;
+}
+
+static void
+footprint_rasterize(obstacle_grid_t *grid, footprint_t *fp, const om_object_t *obj)
+{
+    double res = grid->resolution;
+    double rpy[3];
+    bot_quat_to_roll_pitch_yaw(obj->orientation, rpy);
+    double s, c;
+    bot_fasttrig_sincos(rpy[2], &s, &c);
+
+    // pad by half a cell so that a cell is marked whenever the footprint
+    // overlaps it, and objects smaller than a cell still show up
+    double pad = res / 2.0;
+    double bmin[2] = { MIN(obj->bbox_min[0], obj->bbox_max[0]) - pad,
+                       MIN(obj->bbox_min[1], obj->bbox_max[1]) - pad };
+    double bmax[2] = { MAX(obj->bbox_min[0], obj->bbox_max[0]) + pad,
+                       MAX(obj->bbox_min[1], obj->bbox_max[1]) + pad };
+
+    double wmin[2] = { HUGE_VAL, HUGE_VAL }, wmax[2] = { -HUGE_VAL, -HUGE_VAL };
+    for (int k = 0; k < 4; k++) {
+        double bx = (k & 1) ? bmax[0] : bmin[0];
+        double by = (k & 2) ? bmax[1] : bmin[1];
+        double wx = obj->pos[0] + c*bx - s*by;
+        double wy = obj->pos[1] + s*bx + c*by;
+        wmin[0] = MIN(wmin[0], wx); wmax[0] = MAX(wmax[0], wx);
+        wmin[1] = MIN(wmin[1], wy); wmax[1] = MAX(wmax[1], wy);
+    }
+
+    // check in double, a NaN or far off pose has no int32_t cell index
+    double fi0 = floor(wmin[0] / res), fi1 = floor(wmax[0] / res);
+    double fj0 = floor(wmin[1] / res), fj1 = floor(wmax[1] / res);
+    if (!(fi0 >= -MAX_CELL_INDEX && fi1 <= MAX_CELL_INDEX &&
+          fj0 >= -MAX_CELL_INDEX && fj1 <= MAX_CELL_INDEX)) {
+        ERR("Not rasterizing object %"PRId64": footprint out of range\n",
+            obj->id);
+        return;
+    }
+    double ncells = (fi1 - fi0 + 1) * (fj1 - fj0 + 1);
+    if (!(ncells <= MAX_FOOTPRINT_CELLS)) {
+        ERR("Not rasterizing object %"PRId64": footprint spans %.0f cells\n",
+            obj->id, ncells);
+        return;
+    }
+    int32_t i0 = fi0, i1 = fi1, j0 = fj0, j1 = fj1;
+
+    for (int32_t j = j0; j <= j1; j++) {
+        for (int32_t i = i0; i <= i1; i++) {
+            // cell center in the body frame of the object
+            double dx = (i + 0.5)*res - obj->pos[0];
+            double dy = (j + 0.5)*res - obj->pos[1];
+            double bx =  c*dx + s*dy;
+            double by = -s*dx + c*dy;
+            if (bx < bmin[0] || bx > bmax[0] || by < bmin[1] || by > bmax[1])
+                continue;
+
+            if (fp->num_cells == fp->max_cells) {
+                fp->max_cells = fp->max_cells ? 2*fp->max_cells : 16;
+                fp->cells = realloc(fp->cells, 2*fp->max_cells*sizeof(int32_t));
+            }
+            fp->cells[2*fp->num_cells] = i;
+            fp->cells[2*fp->num_cells+1] = j;
+            fp->num_cells++;
+            grid_cell_add(grid, i, j, +1);
+        }
+    }
+}
+
+obstacle_grid_t *
+obstacle_grid_new(double resolution, int tile_size)
+{
+    if (resolution <= 0 || tile_size <= 0 || tile_size > MAX_TILE_SIZE) {
+        ERR("Error: invalid obstacle grid resolution %f or tile size %d\n",
+            resolution, tile_size);
+        return NULL;
+    }
+
+    obstacle_grid_t *grid = calloc(1, sizeof(obstacle_grid_t));
+    grid->resolution = resolution;
+    grid->tile_size = tile_size;
+    grid->tiles = g_hash_table_new_full(_g_int64_t_hash, _g_int64_t_equal,
+                                        NULL, (GDestroyNotify)tile_destroy);
+    grid->footprints = g_hash_table_new_full(_g_int64_t_hash, _g_int64_t_equal,
+                                             NULL, (GDestroyNotify)footprint_destroy);
+    return grid;
+}
+
+void
+obstacle_grid_destroy(obstacle_grid_t *grid)
+{
+    if (!grid)
+        return;
+
+    g_slist_free(grid->dirty);
+    g_hash_table_destroy(grid->footprints);
+    g_hash_table_destroy(grid->tiles);
+    free(grid);
+}
+
+gboolean
+obstacle_grid_update_object(obstacle_grid_t *grid, const om_object_t *obj)
+{
+    double key[10] = { obj->pos[0], obj->pos[1],
+                       obj->orientation[0], obj->orientation[1],
+                       obj->orientation[2], obj->orientation[3],
+                       obj->bbox_min[0], obj->bbox_min[1],
+                       obj->bbox_max[0], obj->bbox_max[1] };
+
+    footprint_t *fp = g_hash_table_lookup(grid->footprints, &obj->id);
+    if (fp && !memcmp(fp->key, key, sizeof(key)))
+        return FALSE;
+
+    if (fp) {
+        footprint_clear(grid, fp);
+    }
+    else {
+        fp = calloc(1, sizeof(footprint_t));
+        fp->id = obj->id;
+        g_hash_table_insert(grid->footprints, &fp->id, fp);
+    }
+    memcpy(fp->key, key, sizeof(key));
+    footprint_rasterize(grid, fp, obj);
+    return TRUE;
+}
+
+gboolean
+obstacle_grid_remove_object(obstacle_grid_t *grid, int64_t id)
+{
+    footprint_t *fp = g_hash_table_lookup(grid->footprints, &id);
+    if (!fp)
+        return FALSE;
+
+    footprint_clear(grid, fp);
+    g_hash_table_remove(grid->footprints, &id);
+    return TRUE;
+}
+
+static int
+tile_count_runs(const obstacle_grid_t *grid, const grid_tile_t *tile)
+{
+    int ncells = grid->tile_size * grid->tile_size;
+    int nruns = 1;
+    for (int c = 1; c < ncells; c++)
+        if (!tile->counts[c] != !tile->counts[c-1])
+            nruns++;
+    return nruns;
+}
+
+static void
+tile_encode(const obstacle_grid_t *grid, const grid_tile_t *tile,
+            om_occupancy_tile_t *msg)
+{
+    int ncells = grid->tile_size * grid->tile_size;
+    msg->tx = tile->tx;
+    msg->ty = tile->ty;
+    msg->num_runs = tile_count_runs(grid, tile);
+    msg->run_lengths = malloc(msg->num_runs * sizeof(int16_t));
+    msg->run_values = malloc(msg->num_runs * sizeof(uint8_t));
+
+    int r = 0;
+    msg->run_lengths[0] = 1;
+    msg->run_values[0] = tile->counts[0] ? 255 : 0;
+    for (int c = 1; c < ncells; c++) {
+        uint8_t value = tile->counts[c] ? 255 : 0;
+        if (value == msg->run_values[r]) {
+            msg->run_lengths[r]++;
+        }
+        else {
+            r++;
+            msg->run_lengths[r] = 1;
+            msg->run_values[r] = value;
+        }
+    }
+}
+
+int
+obstacle_grid_publish(obstacle_grid_t *grid, lcm_t *lcm, const char *channel,
+                      int64_t utime, gboolean keyframe)
+{
+    GPtrArray *tiles = g_ptr_array_new();
+    if (keyframe) {
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, grid->tiles);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            if (((grid_tile_t *)value)->occupied)
+                g_ptr_array_add(tiles, value);
+    }
+    else {
+        for (GSList *iter = grid->dirty; iter; iter = iter->next)
+            g_ptr_array_add(tiles, iter->data);
+    }
+
+    om_occupancy_grid_t msg = {
+        .utime = utime,
+        .seq = grid->seq++,
+        .resolution = grid->resolution,
+        .tile_size = grid->tile_size,
+        .keyframe = keyframe,
+        .num_tiles = tiles->len,
+        .tiles = calloc(tiles->len ? tiles->len : 1, sizeof(om_occupancy_tile_t))
+    };
+    for (int t = 0; t < tiles->len; t++)
+        tile_encode(grid, tiles->pdata[t], &msg.tiles[t]);
+
+    int status = om_occupancy_grid_t_publish(lcm, channel, &msg);
+
+    for (int t = 0; t < msg.num_tiles; t++) {
+        free(msg.tiles[t].run_lengths);
+        free(msg.tiles[t].run_values);
+    }
+    free(msg.tiles);
+    g_ptr_array_free(tiles, TRUE);
+
+    // forget the dirty set, dropping tiles that no longer hold anything
+    grid->last_tile = NULL;
+    for (GSList *iter = grid->dirty; iter; iter = iter->next) {
+        grid_tile_t *tile = iter->data;
+        tile->dirty = FALSE;
+        if (!tile->occupied)
+            g_hash_table_remove(grid->tiles, &tile->key);
+    }
+    g_slist_free(grid->dirty);
+    grid->dirty = NULL;
+
+    return status;
+}
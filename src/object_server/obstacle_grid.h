@@ -0,0 +1,36 @@
+#ifndef __OBSTACLE_GRID_H
+#define __OBSTACLE_GRID_H
+
+#include <glib.h>
+#include <lcm/lcm.h>
+
+#include <lcmtypes/om_object_t.h>
+
+/*
+ * Tiled 2D occupancy grid of object footprints.
+ *
+ * Every cell counts how many object footprints cover it, so an object
+ * can be moved or removed by un-rasterizing exactly the cells it was
+ * last drawn into. The grid remembers the last footprint of every
+ * object and only touches the cells of objects whose footprint changed.
+ */
+
+typedef struct _obstacle_grid obstacle_grid_t;
+
+obstacle_grid_t *obstacle_grid_new(double resolution, int tile_size);
+
+void obstacle_grid_destroy(obstacle_grid_t *grid);
+
+/* Re-rasterizes obj if its footprint (x, y, orientation, bbox) differs
+ * from the one last drawn for obj->id. Returns TRUE if any cell changed. */
+gboolean obstacle_grid_update_object(obstacle_grid_t *grid, const om_object_t *obj);
+
+/* Clears the footprint last drawn for id. */
+gboolean obstacle_grid_remove_object(obstacle_grid_t *grid, int64_t id);
+
+/* Publishes either every occupied tile (keyframe) or the tiles that changed
+ * since the previous publish, then forgets which tiles were dirty. */
+int obstacle_grid_publish(obstacle_grid_t *grid, lcm_t *lcm, const char *channel,
+                          int64_t utime, gboolean keyframe);
+
+#endif
@@ -0,0 +1,521 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "region_monitor.h"
+
+#define ERR(...) do { fprintf(stderr, "[%s:%d] ", __FILE__, __LINE__); \
+                      fprintf(stderr, __VA_ARGS__); fflush(stderr); } while(0)
+
+// refuse regions covering more buckets than this (bogus coordinates)
+#define MAX_REGION_BUCKETS (1<<16)
+
+// bucket indices must fit in int32_t with room to step past them
+#define MAX_BUCKET_INDEX (1<<30)
+
+typedef struct _mon_object {
+    int64_t  id;
+    int16_t  object_type;
+    double   pos[3];
+    double   yaw;
+    gboolean placed;        // FALSE for anchors not seen yet
+    int64_t  bucket;
+    GSList  *members;       // member_t of the regions it is in
+    GSList  *anchored;      // mon_region_t attached to it
+} mon_object_t;
+
+typedef struct _mon_region {
+    om_region_t *def;       // as registered
+    double  *wx, *wy;       // corners in the world frame
+    double   min[3];        // world bounds
+    double   max[3];
+    gboolean placed;        // FALSE while its anchor is unknown
+    int32_t  bx0, by0, bx1, by1;    // buckets covered, if placed
+    GHashTable *members;    // object id -> member_t
+} mon_region_t;
+
+typedef struct _member {
+    mon_region_t *region;
+    mon_object_t *object;
+    int64_t  enter_utime;
+    gboolean dwelled;       // DWELL reported
+} member_t;
+
+struct _region_monitor {
+    double bucket_size;
+    region_event_func_t func;
+    void  *user;
+
+    GHashTable *regions;        // region id -> mon_region_t
+    GHashTable *objects;        // object id -> mon_object_t
+    GHashTable *region_buckets; // bucket key -> GPtrArray of mon_region_t
+    GHashTable *object_buckets; // bucket key -> set of mon_object_t, by id
+};
+
+static gboolean
+_g_int64_t_equal (gconstpointer v1,gconstpointer v2) {
+    return (*(int64_t*)v1)==(*(int64_t*)v2);
+}
+
+static guint
+_g_int64_t_hash (gconstpointer v) {
+    // fold both halves, bucket keys pack two 32 bit indices
+    int64_t k = *(int64_t *)v;
+    return (guint)(k ^ (k >> 32));
+}
+
+static inline int64_t
+bucket_key(int32_t bx, int32_t by)
+{
+    return ((int64_t)bx << 32) | (uint32_t)by;
+}
+
+/* Clamps far off coordinates to the edge buckets and puts NaN in bucket 0,
+ * where region tests, which compare it, never find it inside. */
+static inline int32_t
+bucket_index(const region_monitor_t *mon, double v)
+{
+    double b = floor(v / mon->bucket_size);
+    if (isnan(b))
+        return 0;
+    return (int32_t)fmax(-MAX_BUCKET_INDEX, fmin(b, MAX_BUCKET_INDEX));
+}
+
+static int64_t *
+key_new(int64_t key)
+{
+    int64_t *k = malloc(sizeof(int64_t));
+    *k = key;
+    return k;
+}
+
+static void
+ptr_array_free(gpointer data)
+{
+    g_ptr_array_free(data, TRUE);
+}
+
+region_monitor_t *
+region_monitor_new(double bucket_size, region_event_func_t func, void *user)
+{
+    region_monitor_t *mon = calloc(1, sizeof(region_monitor_t));
+    mon->bucket_size = bucket_size;
+    mon->func = func;
+    mon->user = user;
+    mon->regions = g_hash_table_new(_g_int64_t_hash, _g_int64_t_equal);
+    mon->objects = g_hash_table_new(_g_int64_t_hash, _g_int64_t_equal);
+    mon->region_buckets = g_hash_table_new_full(_g_int64_t_hash, _g_int64_t_equal,
+                                                free, ptr_array_free);
+    mon->object_buckets = g_hash_table_new_full(_g_int64_t_hash, _g_int64_t_equal,
+                                                free,
+                                                (GDestroyNotify)g_hash_table_destroy);
+    return mon;
+}
+
+static void
+emit(region_monitor_t *mon, const member_t *m, int8_t event, int64_t utime)
+{
+    om_region_event_t ev = {
+        .utime = utime,
+        .region_id = m->region->def->region_id,
+        .object_id = m->object->id,
+        .event = event,
+        .enter_utime = m->enter_utime
+    };
+    memcpy(ev.pos, m->object->pos, sizeof(ev.pos));
+    mon->func(&ev, mon->user);
+}
+
+static void
+member_add(region_monitor_t *mon, mon_region_t *r, mon_object_t *o, int64_t utime)
+{
+    member_t *m = calloc(1, sizeof(member_t));
+    m->region = r;
+    m->object = o;
+    m->enter_utime = utime;
+    g_hash_table_insert(r->members, &o->id, m);
+    o->members = g_slist_prepend(o->members, m);
+    emit(mon, m, OM_REGION_EVENT_T_ENTER, utime);
+}
+
+static void
+member_remove(member_t *m)
+{
+    g_hash_table_remove(m->region->members, &m->object->id);
+    m->object->members = g_slist_remove(m->object->members, m);
+    free(m);
+}
+
+/* Objects are points; a region leaves out its own anchor. */
+static gboolean
+region_contains(const mon_region_t *r, const mon_object_t *o)
+{
+    const om_region_t *def = r->def;
+    if (!r->placed || !o->placed || o->id == def->attached_to)
+        return FALSE;
+    if ((def->object_type >= 0 && o->object_type != def->object_type) ||
+        (def->object_id && o->id != def->object_id))
+        return FALSE;
+
+    double x = o->pos[0], y = o->pos[1];
+    if (x < r->min[0] || x > r->max[0] || y < r->min[1] || y > r->max[1] ||
+        o->pos[2] < r->min[2] || o->pos[2] > r->max[2])
+        return FALSE;
+
+    if (def->num_points == 1) {
+        double dx = x - r->wx[0], dy = y - r->wy[0];
+        return dx*dx + dy*dy <= def->radius * def->radius;
+    }
+
+    // even-odd crossing test
+    gboolean inside = FALSE;
+    for (int i = 0, j = def->num_points - 1; i < def->num_points; j = i++) {
+        if ((r->wy[i] > y) != (r->wy[j] > y) &&
+            x < (r->wx[j] - r->wx[i]) * (y - r->wy[i]) / (r->wy[j] - r->wy[i]) + r->wx[i])
+            inside = !inside;
+    }
+    return inside;
+}
+
+static void
+region_unbucket(region_monitor_t *mon, mon_region_t *r)
+{
+    if (!r->placed)
+        return;
+    for (int32_t bx = r->bx0; bx <= r->bx1; bx++)
+        for (int32_t by = r->by0; by <= r->by1; by++) {
+            int64_t key = bucket_key(bx, by);
+            GPtrArray *bucket = g_hash_table_lookup(mon->region_buckets, &key);
+            if (!bucket)
+                continue;
+            g_ptr_array_remove_fast(bucket, r);
+            if (!bucket->len)
+                g_hash_table_remove(mon->region_buckets, &key);
+        }
+    r->placed = FALSE;
+}
+
+/* Computes where r is in the world and sorts it into its buckets. */
+static void
+region_place(region_monitor_t *mon, mon_region_t *r)
+{
+    const om_region_t *def = r->def;
+    region_unbucket(mon, r);
+
+    double ox = 0, oy = 0, oz = 0, yaw = 0;
+    if (def->attached_to) {
+        mon_object_t *anchor = g_hash_table_lookup(mon->objects, &def->attached_to);
+        if (!anchor || !anchor->placed)
+            return;
+        ox = anchor->pos[0];
+        oy = anchor->pos[1];
+        oz = anchor->pos[2];
+        yaw = anchor->yaw;
+    }
+
+    double c = cos(yaw), s = sin(yaw);
+    double pad = def->num_points == 1 ? def->radius : 0;
+    r->min[0] = r->min[1] = INFINITY;
+    r->max[0] = r->max[1] = -INFINITY;
+    for (int i = 0; i < def->num_points; i++) {
+        r->wx[i] = ox + c*def->x[i] - s*def->y[i];
+        r->wy[i] = oy + s*def->x[i] + c*def->y[i];
+        r->min[0] = fmin(r->min[0], r->wx[i] - pad);
+        r->max[0] = fmax(r->max[0], r->wx[i] + pad);
+        r->min[1] = fmin(r->min[1], r->wy[i] - pad);
+        r->max[1] = fmax(r->max[1], r->wy[i] + pad);
+    }
+    if (def->min_z < def->max_z) {
+        r->min[2] = oz + def->min_z;
+        r->max[2] = oz + def->max_z;
+    }
+    else {
+        r->min[2] = -INFINITY;
+        r->max[2] = INFINITY;
+    }
+
+    if (!isfinite(r->min[0]) || !isfinite(r->max[0]) ||
+        !isfinite(r->min[1]) || !isfinite(r->max[1])) {
+        ERR("Error: region %"PRId64" has no finite bounds, ignoring it\n",
+            def->region_id);
+        return;
+    }
+    int32_t bx0 = bucket_index(mon, r->min[0]), bx1 = bucket_index(mon, r->max[0]);
+    int32_t by0 = bucket_index(mon, r->min[1]), by1 = bucket_index(mon, r->max[1]);
+    if (((double)bx1 - bx0 + 1) * ((double)by1 - by0 + 1) > MAX_REGION_BUCKETS) {
+        ERR("Error: region %"PRId64" is too large, ignoring it\n", def->region_id);
+        return;
+    }
+    r->bx0 = bx0;
+    r->bx1 = bx1;
+    r->by0 = by0;
+    r->by1 = by1;
+    for (int32_t bx = bx0; bx <= bx1; bx++)
+        for (int32_t by = by0; by <= by1; by++) {
+            int64_t key = bucket_key(bx, by);
+            GPtrArray *bucket = g_hash_table_lookup(mon->region_buckets, &key);
+            if (!bucket) {
+                bucket = g_ptr_array_new();
+                g_hash_table_insert(mon->region_buckets, key_new(key), bucket);
+            }
+            g_ptr_array_add(bucket, r);
+        }
+    r->placed = TRUE;
+}
+
+/* Reports the objects that left r and the ones that came into it. */
+static void
+region_evaluate(region_monitor_t *mon, mon_region_t *r, int64_t utime)
+{
+    GList *members = g_hash_table_get_values(r->members);
+    for (GList *iter = members; iter; iter = iter->next) {
+        member_t *m = iter->data;
+        if (!region_contains(r, m->object)) {
+            emit(mon, m, OM_REGION_EVENT_T_EXIT, utime);
+            member_remove(m);
+        }
+    }
+    g_list_free(members);
+
+    if (!r->placed)
+        return;
+    for (int32_t bx = r->bx0; bx <= r->bx1; bx++)
+        for (int32_t by = r->by0; by <= r->by1; by++) {
+            int64_t key = bucket_key(bx, by);
+            GHashTable *bucket = g_hash_table_lookup(mon->object_buckets, &key);
+            if (!bucket)
+                continue;
+            GHashTableIter it;
+            gpointer value;
+            g_hash_table_iter_init(&it, bucket);
+            while (g_hash_table_iter_next(&it, NULL, &value)) {
+                mon_object_t *o = value;
+                if (!g_hash_table_lookup(r->members, &o->id) && region_contains(r, o))
+                    member_add(mon, r, o, utime);
+            }
+        }
+}
+
+/* Reports the regions o left and the ones it came into. */
+static void
+object_evaluate(region_monitor_t *mon, mon_object_t *o, int64_t utime)
+{
+    for (GSList *iter = o->members; iter; ) {
+        member_t *m = iter->data;
+        iter = iter->next;
+        if (!region_contains(m->region, o)) {
+            emit(mon, m, OM_REGION_EVENT_T_EXIT, utime);
+            member_remove(m);
+        }
+    }
+
+    if (!o->placed)
+        return;
+    GPtrArray *bucket = g_hash_table_lookup(mon->region_buckets, &o->bucket);
+    if (!bucket)
+        return;
+    for (int i = 0; i < bucket->len; i++) {
+        mon_region_t *r = g_ptr_array_index(bucket, i);
+        if (!g_hash_table_lookup(r->members, &o->id) && region_contains(r, o))
+            member_add(mon, r, o, utime);
+    }
+}
+
+static mon_object_t *
+object_get(region_monitor_t *mon, int64_t id)
+{
+    mon_object_t *o = g_hash_table_lookup(mon->objects, &id);
+    if (!o) {
+        o = calloc(1, sizeof(mon_object_t));
+        o->id = id;
+        g_hash_table_insert(mon->objects, &o->id, o);
+    }
+    return o;
+}
+
+static void
+object_unbucket(region_monitor_t *mon, mon_object_t *o)
+{
+    if (!o->placed)
+        return;
+    GHashTable *bucket = g_hash_table_lookup(mon->object_buckets, &o->bucket);
+    if (bucket) {
+        g_hash_table_remove(bucket, &o->id);
+        if (!g_hash_table_size(bucket))
+            g_hash_table_remove(mon->object_buckets, &o->bucket);
+    }
+    o->placed = FALSE;
+}
+
+static void
+region_destroy(region_monitor_t *mon, mon_region_t *r)
+{
+    GList *members = g_hash_table_get_values(r->members);
+    for (GList *iter = members; iter; iter = iter->next)
+        member_remove(iter->data);
+    g_list_free(members);
+
+    region_unbucket(mon, r);
+    if (r->def->attached_to) {
+        mon_object_t *anchor = g_hash_table_lookup(mon->objects, &r->def->attached_to);
+        if (anchor)
+            anchor->anchored = g_slist_remove(anchor->anchored, r);
+    }
+    g_hash_table_destroy(r->members);
+    om_region_t_destroy(r->def);
+    free(r->wx);
+    free(r->wy);
+    free(r);
+}
+
+void
+region_monitor_set_region(region_monitor_t *mon, const om_region_t *region,
+                          int64_t utime)
+{
+    mon_region_t *r = g_hash_table_lookup(mon->regions, &region->region_id);
+    if (region->remove) {
+        if (r) {
+            g_hash_table_remove(mon->regions, &r->def->region_id);
+            region_destroy(mon, r);
+        }
+        return;
+    }
+    if (region->num_points != 1 && region->num_points < 3) {
+        ERR("Error: region %"PRId64" needs a point or a polygon, ignoring it\n",
+            region->region_id);
+        return;
+    }
+
+    if (!r) {
+        r = calloc(1, sizeof(mon_region_t));
+        r->members = g_hash_table_new(_g_int64_t_hash, _g_int64_t_equal);
+    }
+    else {
+        g_hash_table_remove(mon->regions, &r->def->region_id);
+        if (r->def->attached_to) {
+            mon_object_t *anchor = g_hash_table_lookup(mon->objects,
+                                                       &r->def->attached_to);
+            if (anchor)
+                anchor->anchored = g_slist_remove(anchor->anchored, r);
+        }
+        om_region_t_destroy(r->def);
+    }
+    r->def = om_region_t_copy(region);
+    g_hash_table_insert(mon->regions, &r->def->region_id, r);
+    r->wx = realloc(r->wx, region->num_points * sizeof(double));
+    r->wy = realloc(r->wy, region->num_points * sizeof(double));
+    if (region->attached_to) {
+        mon_object_t *anchor = object_get(mon, region->attached_to);
+        anchor->anchored = g_slist_prepend(anchor->anchored, r);
+    }
+
+    region_place(mon, r);
+    region_evaluate(mon, r, utime);
+}
+
+void
+region_monitor_update_object(region_monitor_t *mon, const om_object_t *obj,
+                             int64_t utime)
+{
+    mon_object_t *o = object_get(mon, obj->id);
+    o->object_type = obj->object_type;
+    memcpy(o->pos, obj->pos, sizeof(o->pos));
+    const double *q = obj->orientation;
+    o->yaw = atan2(2*(q[0]*q[3] + q[1]*q[2]), 1 - 2*(q[2]*q[2] + q[3]*q[3]));
+
+    int64_t bucket = bucket_key(bucket_index(mon, o->pos[0]),
+                                bucket_index(mon, o->pos[1]));
+    if (!o->placed || bucket != o->bucket) {
+        object_unbucket(mon, o);
+        o->bucket = bucket;
+        GHashTable *set = g_hash_table_lookup(mon->object_buckets, &bucket);
+        if (!set) {
+            set = g_hash_table_new(_g_int64_t_hash, _g_int64_t_equal);
+            g_hash_table_insert(mon->object_buckets, key_new(bucket), set);
+        }
+        g_hash_table_insert(set, &o->id, o);
+    }
+    o->placed = TRUE;
+
+    object_evaluate(mon, o, utime);
+    for (GSList *iter = o->anchored; iter; iter = iter->next) {
+        region_place(mon, iter->data);
+        region_evaluate(mon, iter->data, utime);
+    }
+}
+
+void
+region_monitor_check_dwell(region_monitor_t *mon, int64_t utime)
+{
+    GHashTableIter rit, mit;
+    gpointer rvalue, mvalue;
+    g_hash_table_iter_init(&rit, mon->regions);
+    while (g_hash_table_iter_next(&rit, NULL, &rvalue)) {
+        mon_region_t *r = rvalue;
+        if (r->def->dwell_time <= 0)
+            continue;
+        int64_t dwell_usec = (int64_t)(r->def->dwell_time * 1e6);
+        g_hash_table_iter_init(&mit, r->members);
+        while (g_hash_table_iter_next(&mit, NULL, &mvalue)) {
+            member_t *m = mvalue;
+            if (!m->dwelled && utime - m->enter_utime >= dwell_usec) {
+                m->dwelled = TRUE;
+                emit(mon, m, OM_REGION_EVENT_T_DWELL, utime);
+            }
+        }
+    }
+}
+
+void
+region_monitor_clear_objects(region_monitor_t *mon)
+{
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, mon->objects);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        mon_object_t *o = value;
+        while (o->members)
+            member_remove(o->members->data);
+        o->placed = FALSE;
+        // anchors stay known, their regions refer to them
+        if (!o->anchored) {
+            g_hash_table_iter_remove(&iter);
+            free(o);
+        }
+    }
+    g_hash_table_remove_all(mon->object_buckets);
+
+    g_hash_table_iter_init(&iter, mon->regions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        mon_region_t *r = value;
+        if (r->def->attached_to)
+            region_unbucket(mon, r);
+    }
+}
+
+void
+region_monitor_destroy(region_monitor_t *mon)
+{
+    if (!mon)
+        return;
+    GList *regions = g_hash_table_get_values(mon->regions);
+    for (GList *iter = regions; iter; iter = iter->next)
+        region_destroy(mon, iter->data);
+    g_list_free(regions);
+    g_hash_table_destroy(mon->regions);
+
+    GList *objects = g_hash_table_get_values(mon->objects);
+    for (GList *iter = objects; iter; iter = iter->next) {
+        mon_object_t *o = iter->data;
+        g_slist_free(o->members);
+        g_slist_free(o->anchored);
+        free(o);
+    }
+    g_list_free(objects);
+    g_hash_table_destroy(mon->objects);
+    g_hash_table_destroy(mon->region_buckets);
+    g_hash_table_destroy(mon->object_buckets);
+    free(mon);
+}
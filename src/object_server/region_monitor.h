@@ -0,0 +1,46 @@
+#ifndef __REGION_MONITOR_H
+#define __REGION_MONITOR_H
+
+#include <glib.h>
+
+#include <lcmtypes/om_object_t.h>
+#include <lcmtypes/om_region_t.h>
+#include <lcmtypes/om_region_event_t.h>
+
+/*
+ * Registered regions and the objects in them.
+ *
+ * Regions and object positions are both sorted into the buckets of a
+ * coarse 2D grid. An object that moved is tested against the regions in
+ * its bucket and the ones it was in; a region that moved or changed,
+ * against the objects in the buckets it covers and the ones it had.
+ * Events go to a callback as they are found.
+ */
+
+typedef struct _region_monitor region_monitor_t;
+
+typedef void (*region_event_func_t)(const om_region_event_t *event, void *user);
+
+region_monitor_t *region_monitor_new(double bucket_size,
+                                     region_event_func_t func, void *user);
+
+void region_monitor_destroy(region_monitor_t *mon);
+
+/* Adds or replaces region, or removes it if region->remove is set. Objects
+ * found inside get ENTER events, ones no longer inside EXIT events; a
+ * removed region reports nothing. */
+void region_monitor_set_region(region_monitor_t *mon, const om_region_t *region,
+                               int64_t utime);
+
+/* Takes obj at its current pose, reports it entering and leaving regions
+ * and brings along the regions attached to it. */
+void region_monitor_update_object(region_monitor_t *mon, const om_object_t *obj,
+                                  int64_t utime);
+
+/* Reports the objects that have been in a region for its dwell_time. */
+void region_monitor_check_dwell(region_monitor_t *mon, int64_t utime);
+
+/* Forgets every object without reporting anything, keeping the regions. */
+void region_monitor_clear_objects(region_monitor_t *mon);
+
+#endif